@@ -18,12 +18,21 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cassert>
+#include <chrono>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <istream>
+#include <map>
 #include <vector>
 
+#include "endgame.h"
+#include "evaluate.h"
+#include "misc.h"
+#include "movegen.h"
 #include "position.h"
+#include "thread.h"
 
 using namespace std;
 
@@ -67,8 +76,123 @@ const vector<string> Defaults = {
   "8/8/8/8/k1M5/2S5/1K6/8 b 3 2"       // kbqk
 };
 
+  // time_lookups() returns the average time in nanoseconds of a lookup of the
+  // given keys, cycled through until the number of iterations is reached. The
+  // number of successful lookups is stored in hits.
+  template<typename Lookup>
+  double time_lookups(const vector<Key>& keys, uint64_t iterations, uint64_t& hits, Lookup lookup) {
+
+    auto start = chrono::steady_clock::now();
+    hits = 0;
+
+    for (size_t n = 0, i = 0; n < iterations; ++n, i = (i + 1 < keys.size() ? i + 1 : 0))
+        hits += lookup(keys[i]) != nullptr;
+
+    // Keep the compiler from moving the loop past the end of the timing
+    volatile uint64_t sink = hits;
+    (void)sink;
+
+    chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+    return elapsed.count() / iterations;
+  }
+
+  // bench_endgames() compares lookups in the Endgames registry against the
+  // same entries in a std::map. Every other key is a miss, as most material
+  // configurations have no specialized endgame.
+  void bench_endgames(uint64_t iterations) {
+
+    const Endgames::Map<Value>& registry = Endgames::map<Value>();
+    map<Key, const EndgameBase<Value>*> tree;
+    vector<Key> keys;
+    PRNG rng(1070372);
+
+    for (size_t i = 0; i < registry.size(); ++i)
+    {
+        tree[registry.key(i)] = registry[i];
+        keys.push_back(registry.key(i));
+        keys.push_back(rng.rand<Key>());
+    }
+
+    uint64_t treeHits, hashHits;
+
+    double treeTime = time_lookups(keys, iterations, treeHits, [&](Key k) {
+        auto it = tree.find(k);
+        return it != tree.end() ? it->second : nullptr;
+    });
+
+    double hashTime = time_lookups(keys, iterations, hashHits, [&](Key k) {
+        return registry.probe(k);
+    });
+
+    assert(treeHits == hashHits);
+
+    cerr << "\nEndgames registry: " << registry.size() << " functions, "
+         << iterations << " lookups, " << hashHits << " hits"
+         << fixed << setprecision(2)
+         << "\nstd::map (ns/lookup)      : " << treeTime
+         << "\nEndgames::Map (ns/lookup) : " << hashTime << endl;
+  }
+
+  // bench_nnue() times the first layer of the network on the bench positions
+  // and on every position one move away from them, which are the nodes at the
+  // top of the bench searches.
+  void bench_nnue(uint64_t iterations) {
+
+    if (!Eval::useNNUE)
+    {
+        cerr << "microbench nnue needs a network, set the option Use NNUE first" << endl;
+        return;
+    }
+
+    vector<string> fens;
+    StateInfo st, childSt;
+    Position pos;
+
+    for (const string& fen : Defaults)
+    {
+        pos.set(fen, false, &st, Threads.main());
+        fens.push_back(fen);
+
+        for (const auto& m : MoveList<LEGAL>(pos))
+        {
+            pos.do_move(m, childSt);
+            fens.push_back(pos.fen());
+            pos.undo_move(m);
+        }
+    }
+
+    Eval::NNUE::time_first_layer(fens, iterations);
+  }
+
 } // namespace
 
+
+/// microbench() times a single engine component in isolation, outside of a
+/// search. The second parameter is the number of iterations.
+///
+/// microbench endgames -> 10M lookups in the Endgames registry
+/// microbench endgames 100000000 -> 100M lookups in the Endgames registry
+/// microbench nnue -> 10M propagations of the first NNUE layer, dense and sparse
+
+void microbench(istream& is) {
+
+  string name, token;
+  uint64_t iterations = 10000000;
+
+  is >> name;
+
+  if (is >> token)
+      iterations = max(uint64_t(stoull(token)), uint64_t(1));
+
+  if (name == "endgames")
+      bench_endgames(iterations);
+  else if (name == "nnue")
+      bench_nnue(iterations);
+  else
+      cerr << "Usage: microbench endgames|nnue [iterations]" << endl;
+}
+
+
 /// setup_bench() builds a list of UCI commands to be run by bench. There
 /// are five parameters: TT size in MB, number of search threads that
 /// should be used, the limit value spent for each position, a file name
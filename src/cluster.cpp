@@ -0,0 +1,654 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2021 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "cluster.h"
+#include "misc.h"
+#include "thread.h"
+#include "tt.h"
+#include "uci.h"
+
+namespace Cluster {
+
+std::atomic<bool> Sharing;
+
+namespace {
+
+  constexpr size_t BufferSize = 1024;   // Entries waiting to be sent per thread, later ones are dropped
+  constexpr size_t BatchSize = 64;      // Entries per "ttshare" line
+  constexpr TimePoint FlushPeriod = 20; // Milliseconds between two sends
+
+  struct SharedEntry {
+    Key key;
+    Move move;
+    Value value, eval;
+    Depth depth;
+    Bound bound;
+    bool pv;
+  };
+
+  // A ShareBuffer is a ring of entries with a single producer, the search
+  // thread that owns it, and a single consumer, flush() on the main thread,
+  // so that deep TT stores do not contend on a lock.
+  struct ShareBuffer {
+    SharedEntry entries[BufferSize];
+    std::atomic<size_t> head{0}, tail{0};
+  };
+
+  // A Worker is the coordinator side of a connection. Its reader thread keeps
+  // the last PV line with an exact score and the bestmove line of the current
+  // search, and stores the TT entries sent by the worker.
+  struct Worker {
+    int fd;
+    std::thread reader;
+    std::mutex mutex, writeMutex;
+    std::condition_variable cv;
+    bool started = false, searching = false;
+    std::string info, bestmove;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::string positionCmd = "position startpos";
+  std::map<std::string, std::string> optionCmds; // Last "setoption" of each option
+  std::mutex ttMutex;
+  std::vector<std::unique_ptr<ShareBuffer>> buffers; // One per search thread
+  TimePoint lastFlush;
+  bool acceptEntries; // Guarded by ttMutex, true while the coordinator searches
+
+  // go_command() rebuilds a "go" command from the search limits, without the
+  // ponder flag since the coordinator decides when the search stops.
+  std::string go_command(const Search::LimitsType& limits) {
+
+    std::ostringstream ss;
+    ss << "go";
+
+    if (limits.time[WHITE]) ss << " wtime "     << limits.time[WHITE];
+    if (limits.time[BLACK]) ss << " btime "     << limits.time[BLACK];
+    if (limits.inc[WHITE])  ss << " winc "      << limits.inc[WHITE];
+    if (limits.inc[BLACK])  ss << " binc "      << limits.inc[BLACK];
+    if (limits.movestogo)   ss << " movestogo " << limits.movestogo;
+    if (limits.depth)       ss << " depth "     << limits.depth;
+    if (limits.nodes)       ss << " nodes "     << limits.nodes;
+    if (limits.movetime)    ss << " movetime "  << limits.movetime;
+    if (limits.mate)        ss << " mate "      << limits.mate;
+    if (limits.infinite)    ss << " infinite";
+
+    return ss.str();
+  }
+
+  // parse_info() reads the depth and the score of an "info ... pv" line. It is
+  // the inverse of UCI::value() for the score.
+  void parse_info(const std::string& line, Value& score, int& depth) {
+
+    std::istringstream is(line);
+    std::string token;
+    int v;
+
+    while (is >> token && token != "pv")
+        if (token == "depth")
+            is >> depth;
+
+        else if (token == "score" && is >> token >> v)
+            score = token == "cp" ? Value(v * PawnValueEg / 100)
+                  : v > 0         ? VALUE_MATE - 2 * v + 1
+                                  : -VALUE_MATE - 2 * v;
+  }
+
+#ifndef _WIN32
+
+  // open_socket() returns a socket bound to the address when server is true,
+  // and connected to it otherwise, or -1 on failure.
+  int open_socket(const std::string& address, bool server) {
+
+    if (address.compare(0, 5, "unix:") == 0)
+    {
+        std::string path = address.substr(5);
+        sockaddr_un sa;
+
+        std::memset(&sa, 0, sizeof(sa));
+        sa.sun_family = AF_UNIX;
+
+        if (path.empty() || path.size() >= sizeof(sa.sun_path))
+            return -1;
+
+        std::memcpy(sa.sun_path, path.c_str(), path.size());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+
+        if (server)
+            unlink(path.c_str()); // Stale socket left by a previous worker
+
+        if ((server ? bind(fd, (sockaddr*)&sa, sizeof(sa))
+                    : ::connect(fd, (sockaddr*)&sa, sizeof(sa))) < 0)
+        {
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos)
+        return -1;
+
+    // Without a host only local processes can reach a worker, which has no
+    // authentication. Other interfaces must be asked for by name, e.g. 0.0.0.0.
+    std::string host = address.substr(0, colon), port = address.substr(colon + 1);
+    addrinfo hints, *res;
+
+    if (host.empty())
+        host = "127.0.0.1";
+
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res))
+        return -1;
+
+    int fd = -1, one = 1;
+
+    for (addrinfo* ai = res; ai && fd < 0; ai = ai->ai_next)
+    {
+        if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) < 0)
+            continue;
+
+        if (server)
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        else
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        if ((server ? bind(fd, ai->ai_addr, ai->ai_addrlen)
+                    : ::connect(fd, ai->ai_addr, ai->ai_addrlen)) < 0)
+        {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    freeaddrinfo(res);
+    return fd;
+  }
+
+  void send_line(Worker& w, const std::string& line) {
+
+    std::lock_guard<std::mutex> lk(w.writeMutex);
+    std::string s = line + "\n";
+
+    for (size_t sent = 0; sent < s.size(); )
+    {
+        ssize_t n = send(w.fd, s.data() + sent, s.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return; // Connection lost, the reader thread notices it too
+        sent += size_t(n);
+    }
+  }
+
+  void handle_line(Worker& w, const std::string& line) {
+
+    if (line.compare(0, 8, "ttshare ") == 0)
+    {
+        std::lock_guard<std::mutex> lk(ttMutex);
+        if (acceptEntries)
+        {
+            std::istringstream is(line.substr(8));
+            receive(is);
+        }
+    }
+    else if (line.compare(0, 9, "bestmove ") == 0)
+    {
+        std::lock_guard<std::mutex> lk(w.mutex);
+        w.bestmove = line;
+        w.searching = false;
+        w.cv.notify_all();
+    }
+    // Bound scores, e.g. of an iteration cut short by a stop, are not comparable
+    // with the exact scores of the other processes in the vote.
+    else if (   line.compare(0, 5, "info ") == 0
+             && line.find(" pv ") != std::string::npos
+             && line.find(" upperbound ") == std::string::npos
+             && line.find(" lowerbound ") == std::string::npos)
+    {
+        std::lock_guard<std::mutex> lk(w.mutex);
+        w.info = line;
+    }
+  }
+
+  void read_loop(Worker* w) {
+
+    std::string buffer;
+    char chunk[4096];
+    ssize_t n;
+
+    while ((n = recv(w->fd, chunk, sizeof(chunk), 0)) > 0)
+    {
+        buffer.append(chunk, size_t(n));
+
+        size_t start = 0, end;
+        while ((end = buffer.find('\n', start)) != std::string::npos)
+        {
+            handle_line(*w, buffer.substr(start, end - start));
+            start = end + 1;
+        }
+        buffer.erase(0, start);
+    }
+
+    // The connection is closed, do not wait for this worker any longer
+    std::lock_guard<std::mutex> lk(w->mutex);
+    w->searching = false;
+    w->cv.notify_all();
+  }
+
+  void disconnect(Worker& w) {
+    shutdown(w.fd, SHUT_RDWR);
+    w.reader.join();
+    close(w.fd);
+  }
+
+#else
+
+  void send_line(Worker&, const std::string&) {}
+  void disconnect(Worker&) {}
+
+#endif
+
+} // namespace
+
+
+/// Cluster::listen() is called by a worker at startup. It waits for the
+/// coordinator and then makes the connection the standard input and output of
+/// the process, so that the UCI loop serves the coordinator.
+
+void listen(const std::string& address) {
+
+#ifndef _WIN32
+  int server = open_socket(address, true);
+
+  if (server < 0 || ::listen(server, 1) < 0)
+  {
+      std::cerr << "Unable to listen on " << address << std::endl;
+      std::exit(EXIT_FAILURE);
+  }
+
+  std::cerr << "Waiting for the coordinator on " << address << std::endl;
+
+  int fd = accept(server, nullptr, nullptr);
+  close(server);
+
+  if (fd < 0)
+  {
+      std::cerr << "Unable to accept a connection on " << address << std::endl;
+      std::exit(EXIT_FAILURE);
+  }
+
+  dup2(fd, STDIN_FILENO);
+  dup2(fd, STDOUT_FILENO);
+  close(fd);
+
+  Sharing = true;
+#else
+  std::cerr << "Worker mode is not supported on this platform" << std::endl;
+  std::exit(EXIT_FAILURE);
+#endif
+}
+
+
+/// Cluster::connect() closes the current connections and connects to the
+/// comma separated worker addresses. The workers get the options set so far
+/// on the coordinator.
+
+void connect(const std::string& addresses) {
+
+  for (auto& w : workers)
+      disconnect(*w);
+
+  workers.clear();
+  Sharing = false;
+
+  if (addresses.empty() || addresses == "<empty>")
+      return;
+
+#ifndef _WIN32
+  std::istringstream ss(addresses);
+  std::string address;
+
+  while (std::getline(ss, address, ','))
+  {
+      address.erase(0, address.find_first_not_of(' '));
+      address.erase(address.find_last_not_of(' ') + 1);
+
+      int fd = open_socket(address, false);
+
+      if (fd < 0)
+      {
+          sync_cout << "info string Unable to connect to worker " << address << sync_endl;
+          continue;
+      }
+
+      workers.emplace_back(new Worker);
+      Worker& w = *workers.back();
+      w.fd = fd;
+      w.reader = std::thread(read_loop, &w);
+
+      for (const auto& o : optionCmds)
+          send_line(w, o.second);
+
+      send_line(w, "ucinewgame");
+  }
+
+  Sharing = !workers.empty();
+
+  sync_cout << "info string Connected to " << workers.size() << " cluster workers" << sync_endl;
+#else
+  sync_cout << "info string Cluster mode is not supported on this platform" << sync_endl;
+#endif
+}
+
+
+/// Cluster::set_position() records the last "position" command, which is sent
+/// to the workers before each search.
+
+void set_position(const std::string& cmd) {
+  positionCmd = cmd;
+}
+
+
+/// Cluster::set_option() forwards a "setoption" to the workers and records it
+/// for the workers connected later, so that all the processes search with the
+/// same settings and their scores can be compared in the vote.
+
+void set_option(const std::string& name, const std::string& value) {
+
+  if (name == "Cluster Workers" || name == "Debug Log File")
+      return;
+
+  std::string cmd = "setoption name " + name + (value.empty() ? "" : " value " + value);
+
+  if (!value.empty()) // Buttons are not replayed
+      optionCmds[name] = cmd;
+
+  for (auto& w : workers)
+      send_line(*w, cmd);
+}
+
+
+/// Cluster::new_game() forwards "ucinewgame" to the workers
+
+void new_game() {
+
+  for (auto& w : workers)
+      send_line(*w, "ucinewgame");
+}
+
+
+/// Cluster::start() deals the root moves in turn to the coordinator and to the
+/// workers, starts the workers on their share and keeps the coordinator's one
+/// in rootMoves. Searches with a single root move are not split, nor MultiPV
+/// searches whose lines must all come from the same process.
+
+void start(Search::RootMoves& rootMoves, const Search::LimitsType& limits) {
+
+  // The threads are idle here, so the buffers can be added safely
+  while (buffers.size() < Threads.size())
+      buffers.emplace_back(new ShareBuffer);
+
+  if (   workers.empty()
+      || rootMoves.size() < 2
+      || limits.perft
+      || size_t(Options["MultiPV"]) > 1)
+      return;
+
+  const size_t n = workers.size() + 1;
+  std::vector<std::string> shares(workers.size());
+  Search::RootMoves ours;
+
+  for (size_t i = 0; i < rootMoves.size(); ++i)
+      if (i % n == 0)
+          ours.push_back(rootMoves[i]);
+      else
+          shares[i % n - 1] += " " + UCI::move(rootMoves[i].pv[0]);
+
+  {
+      std::lock_guard<std::mutex> lk(ttMutex);
+      acceptEntries = true;
+  }
+
+  for (size_t i = 0; i < workers.size(); ++i)
+      if (!shares[i].empty())
+      {
+          Worker& w = *workers[i];
+          {
+              std::lock_guard<std::mutex> lk(w.mutex);
+              w.started = w.searching = true;
+              w.info.clear();
+              w.bestmove.clear();
+          }
+          send_line(w, positionCmd);
+          send_line(w, go_command(limits) + " searchmoves" + shares[i]);
+      }
+
+  rootMoves = ours;
+}
+
+
+/// Cluster::stop() forwards a "stop" from the GUI to the workers still
+/// searching, so that searches with a depth, nodes or mate limit end at once.
+
+void stop() {
+
+  for (auto& w : workers)
+  {
+      bool searching;
+      {
+          std::lock_guard<std::mutex> lk(w->mutex);
+          searching = w->searching;
+      }
+
+      if (searching)
+          send_line(*w, "stop");
+  }
+}
+
+
+/// Cluster::finish() is called by the main thread once its own search is over.
+/// It collects the results of the workers and votes among them and the local
+/// best move, with the same weights as among the threads. If a worker wins its
+/// PV and best move are sent to the GUI and the function returns true.
+
+bool finish(Move move, Value score, Depth depth) {
+
+  struct Candidate {
+    std::string move;
+    Value score;
+    int depth;
+    Worker* worker;
+  };
+
+  std::vector<Candidate> candidates = { { UCI::move(move), score, int(depth), nullptr } };
+
+  // Searches that we stop on our own stop the workers too, the others run
+  // until their own limit is reached or the GUI stops them with stop().
+  bool stop =   Search::Limits.use_time_management()
+             || Search::Limits.movetime
+             || Search::Limits.infinite;
+
+  for (auto& w : workers)
+      if (w->started && stop)
+          send_line(*w, "stop");
+
+  for (auto& w : workers)
+  {
+      std::unique_lock<std::mutex> lk(w->mutex);
+
+      if (!w->started)
+          continue;
+
+      w->cv.wait(lk, [&]{ return !w->searching; });
+      w->started = false;
+
+      if (w->bestmove.empty() || w->info.empty())
+          continue; // Connection lost
+
+      Candidate c = { "", -VALUE_INFINITE, 0, w.get() };
+      std::istringstream is(w->bestmove);
+      is >> c.move >> c.move;
+      parse_info(w->info, c.score, c.depth);
+      candidates.push_back(c);
+  }
+
+  {
+      std::lock_guard<std::mutex> lk(ttMutex);
+      acceptEntries = false;
+  }
+
+  if (candidates.size() == 1 || move == MOVE_NONE)
+      return false;
+
+  std::map<std::string, int64_t> votes;
+  Value minScore = score;
+  Candidate* best = &candidates[0];
+
+  for (const Candidate& c : candidates)
+      minScore = std::min(minScore, c.score);
+
+  for (Candidate& c : candidates)
+  {
+      votes[c.move] += (c.score - minScore + 14) * c.depth;
+
+      if (best->score >= VALUE_MATE_IN_MAX_PLY)
+      {
+          if (c.score > best->score)
+              best = &c;
+      }
+      else if (   c.score >= VALUE_MATE_IN_MAX_PLY
+               || votes[c.move] > votes[best->move])
+          best = &c;
+  }
+
+  if (!best->worker)
+      return false;
+
+  sync_cout << best->worker->info << "\n" << best->worker->bestmove << sync_endl;
+  return true;
+}
+
+
+/// Cluster::share() queues a TT entry for the other processes in the buffer
+/// of the calling thread.
+
+void share(size_t idx, Key key, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
+
+  ShareBuffer& buf = *buffers[idx];
+  size_t head = buf.head.load(std::memory_order_relaxed);
+
+  if (head - buf.tail.load(std::memory_order_acquire) < BufferSize)
+  {
+      buf.entries[head % BufferSize] = { key, m, v, ev, d, b, pv };
+      buf.head.store(head + 1, std::memory_order_release);
+  }
+}
+
+
+/// Cluster::flush() sends the queued TT entries, at most every FlushPeriod. A
+/// worker writes them to its standard output, the coordinator to all workers.
+
+void flush() {
+
+  if (!Sharing.load(std::memory_order_relaxed) || now() - lastFlush < FlushPeriod)
+      return;
+
+  lastFlush = now();
+  std::vector<SharedEntry> entries;
+
+  for (auto& buf : buffers)
+  {
+      size_t tail = buf->tail.load(std::memory_order_relaxed);
+      size_t head = buf->head.load(std::memory_order_acquire);
+
+      for ( ; tail != head; ++tail)
+          entries.push_back(buf->entries[tail % BufferSize]);
+
+      buf->tail.store(tail, std::memory_order_release);
+  }
+
+  for (size_t i = 0; i < entries.size(); i += BatchSize)
+  {
+      std::ostringstream ss;
+      ss << "ttshare";
+
+      for (size_t j = i; j < std::min(i + BatchSize, entries.size()); ++j)
+      {
+          const SharedEntry& e = entries[j];
+          ss << ' ' << e.key << ' ' << int(e.move) << ' ' << int(e.value)
+             << ' ' << int(e.eval) << ' ' << int(e.depth) << ' ' << int(e.bound)
+             << ' ' << int(e.pv);
+      }
+
+      if (workers.empty())
+          sync_cout << ss.str() << sync_endl;
+      else
+          for (auto& w : workers)
+              send_line(*w, ss.str());
+  }
+}
+
+
+/// Cluster::receive() stores the entries of a "ttshare" line in the TT, unless
+/// a deeper entry is already there.
+
+void receive(std::istream& is) {
+
+  Key key;
+  int move, value, eval, depth, bound, pv;
+
+  while (is >> key >> move >> value >> eval >> depth >> bound >> pv)
+  {
+      bool found;
+      TTEntry tte = TT.probe(key, found);
+
+      if (!found || tte.depth() < Depth(depth))
+          tte.save(key, Value(value), pv, Bound(bound), Depth(depth), Move(move), Value(eval));
+  }
+}
+
+} // namespace Cluster
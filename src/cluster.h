@@ -0,0 +1,65 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2021 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CLUSTER_H_INCLUDED
+#define CLUSTER_H_INCLUDED
+
+#include <atomic>
+#include <istream>
+#include <string>
+
+#include "search.h"
+#include "types.h"
+
+/// The Cluster namespace lets several engine processes search the same position.
+/// Workers are ordinary engines started with "worker <address>", which speak UCI
+/// over the connection instead of stdin and stdout. The process talking to the
+/// GUI connects to the workers listed in the "Cluster Workers" option, gives each
+/// of them a share of the root moves, exchanges deep TT entries with them during
+/// the search and votes among all the results for the best move. Addresses are
+/// "host:port" for TCP or "unix:<path>" for Unix domain sockets.
+///
+/// A worker does not authenticate its coordinator: whoever connects first drives
+/// the engine. ":port" listens on the loopback interface only, and a worker
+/// refuses the commands that write files on its host, but a worker listening on
+/// another interface should only be reachable from trusted hosts.
+
+namespace Cluster {
+
+/// Only entries of at least this depth are sent to the other processes
+constexpr Depth ShareDepth = 8 * ONE_PLY;
+
+extern std::atomic<bool> Sharing; // True in a worker or when connected to workers
+
+void listen(const std::string& address);
+void connect(const std::string& addresses);
+void set_position(const std::string& cmd);
+void set_option(const std::string& name, const std::string& value);
+void new_game();
+void start(Search::RootMoves& rootMoves, const Search::LimitsType& limits);
+void stop();
+bool finish(Move move, Value score, Depth depth);
+void share(size_t idx, Key key, Value v, bool pv, Bound b, Depth d, Move m, Value ev);
+void flush();
+void receive(std::istream& is);
+
+} // namespace Cluster
+
+#endif // #ifndef CLUSTER_H_INCLUDED
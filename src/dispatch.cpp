@@ -0,0 +1,115 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2021 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Entry point of the dispatching build. The Makefile builds the whole engine
+// once for each entry of DISPATCH_COPIES and links each build on its own, with
+// only its main() left visible and renamed to engine_<copy>(). The choice of
+// the instruction set is thus made once, here, and the chosen build runs the
+// same code as the matching specific ARCH.
+
+#include <cpuid.h>
+#include <cstdint>
+#include <cstring>
+
+#include "incbin/incbin.h"
+
+// The copies share the net embedded here, see evaluate.cpp
+#if !defined(NNUE_EMBEDDING_OFF)
+  INCBIN(EmbeddedNNUE, EvalFileEmbedded);
+#endif
+
+// One for each entry of DISPATCH_COPIES in the Makefile
+extern "C" {
+  int engine_sse2(int argc, char* argv[]);
+  int engine_sse41(int argc, char* argv[]);
+  int engine_avx2(int argc, char* argv[]);
+  int engine_bmi2(int argc, char* argv[]);
+  int engine_avx512(int argc, char* argv[]);
+  int engine_vnni(int argc, char* argv[]);
+}
+
+namespace {
+
+/// CpuFeatures reads the instruction set extensions from CPUID. The AVX ones
+/// also need the operating system to save the wider registers on a context
+/// switch, which XGETBV tells.
+
+struct CpuFeatures {
+
+  bool popcnt = false, pext = false, ssse3 = false, sse41 = false;
+  bool avx2 = false, avx512 = false, vnni = false;
+
+  CpuFeatures() {
+
+    unsigned a, b, c, d, vendor[3];
+
+    __cpuid(0, a, vendor[0], vendor[2], vendor[1]);
+    unsigned maxLeaf = a;
+
+    __cpuid(1, a, b, c, d);
+    unsigned family = ((a >> 8) & 0xF) + ((a >> 20) & 0xFF);
+
+    popcnt = c & bit_POPCNT;
+    ssse3  = c & bit_SSSE3;
+    sse41  = c & bit_SSE4_1;
+
+    uint64_t xcr0 = 0;
+    if (c & bit_OSXSAVE)
+    {
+        unsigned lo, hi;
+        __asm__("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+        xcr0 = (uint64_t(hi) << 32) | lo;
+    }
+
+    bool ymmSaved = (xcr0 & 0x06) == 0x06;
+    bool zmmSaved = (xcr0 & 0xE6) == 0xE6;
+
+    if (maxLeaf < 7)
+        return;
+
+    __cpuid_count(7, 0, a, b, c, d);
+
+    // Before Zen 3, AMD CPUs run pext in microcode, slower than the magics
+    bool amd = !std::memcmp(vendor, "AuthenticAMD", 12);
+    pext   = (b & bit_BMI2) && !(amd && family < 0x19);
+    avx2   = ymmSaved && (b & bit_AVX2);
+    avx512 = zmmSaved && (b & bit_AVX512F) && (b & bit_AVX512BW);
+    vnni   = avx512 && (b & bit_AVX512DQ) && (b & bit_AVX512VL) && (c & bit_AVX512VNNI);
+  }
+};
+
+} // namespace
+
+
+/// main() runs the fastest build that the CPU and the operating system support
+
+int main(int argc, char* argv[]) {
+
+  const CpuFeatures cpu;
+
+  auto engine =  cpu.vnni   && cpu.pext ? engine_vnni
+               : cpu.avx512 && cpu.pext ? engine_avx512
+               : cpu.avx2   && cpu.pext ? engine_bmi2
+               : cpu.avx2   && cpu.popcnt ? engine_avx2
+               : cpu.sse41  && cpu.ssse3 && cpu.popcnt ? engine_sse41
+                                        : engine_sse2;
+
+  return engine(argc, argv);
+}
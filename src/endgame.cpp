@@ -190,6 +190,9 @@ namespace Endgames {
     add<KNNKNP>("KNNKNP");
     add<KNNKNQ>("KNNKNM");
     add<KNNKNB>("KNNKNS");
+
+    map<Value>().build();
+    map<ScaleFactor>().build();
   }
 }
 
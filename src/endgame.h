@@ -21,11 +21,12 @@
 #ifndef ENDGAME_H_INCLUDED
 #define ENDGAME_H_INCLUDED
 
-#include <map>
+#include <cassert>
 #include <memory>
 #include <string>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "position.h"
 #include "types.h"
@@ -217,13 +218,88 @@ struct Endgame : public EndgameBase<T> {
 
 
 /// The Endgames namespace handles the pointers to endgame evaluation and scaling
-/// base objects in two std::map. We use polymorphism to invoke the actual
-/// endgame function by calling its virtual operator().
+/// base objects in two Map. We use polymorphism to invoke the actual endgame
+/// function by calling its virtual operator().
 
 namespace Endgames {
 
   template<typename T> using Ptr = std::unique_ptr<EndgameBase<T>>;
-  template<typename T> using Map = std::map<Key, Ptr<T>>;
+
+  /// Map is an immutable open addressing hash table from material keys to endgame
+  /// functions. It is filled by add() and built by init() once all entries are
+  /// known. A slot holds the key next to the index of the function, and the table
+  /// is kept at most half full with linear probing, so a lookup usually reads a
+  /// single cache line. Key 0 marks an empty slot.
+
+  template<typename T>
+  class Map {
+
+    struct Slot {
+      Key key;
+      size_t index;
+    };
+
+  public:
+    void insert(Key key, Ptr<T>&& eg) {
+
+      assert(key && slots.empty());
+
+      for (size_t i = 0; i < keys.size(); ++i)
+          if (keys[i] == key)
+          {
+              functions[i] = std::move(eg);
+              return;
+          }
+
+      keys.push_back(key);
+      functions.push_back(std::move(eg));
+    }
+
+    void build() {
+
+      size_t size = 2;
+      while (size < 2 * keys.size())
+          size *= 2;
+
+      slots.assign(size, Slot{ 0, 0 });
+      mask = size - 1;
+
+      for (size_t i = 0; i < keys.size(); ++i)
+      {
+          size_t idx = keys[i] & mask;
+          while (slots[idx].key)
+              idx = (idx + 1) & mask;
+
+          slots[idx] = { keys[i], i };
+      }
+    }
+
+    // index() returns the position of the function registered for the key in
+    // insertion order, or -1 if there is none.
+    int index(Key key) const {
+
+      for (size_t idx = key & mask; slots[idx].key; idx = (idx + 1) & mask)
+          if (slots[idx].key == key)
+              return int(slots[idx].index);
+
+      return -1;
+    }
+
+    const EndgameBase<T>* probe(Key key) const {
+      int i = index(key);
+      return i >= 0 ? functions[i].get() : nullptr;
+    }
+
+    size_t size() const { return functions.size(); }
+    Key key(size_t i) const { return keys[i]; }
+    const EndgameBase<T>* operator[](size_t i) const { return functions[i].get(); }
+
+  private:
+    std::vector<Key> keys;
+    std::vector<Ptr<T>> functions;
+    std::vector<Slot> slots;
+    size_t mask = 0;
+  };
 
   extern std::pair<Map<Value>, Map<ScaleFactor>> maps;
 
@@ -238,13 +314,13 @@ namespace Endgames {
   void add(const std::string& code) {
 
     StateInfo st;
-    map<T>()[Position().set(code, WHITE, &st).material_key()] = Ptr<T>(new Endgame<E>(WHITE));
-    map<T>()[Position().set(code, BLACK, &st).material_key()] = Ptr<T>(new Endgame<E>(BLACK));
+    map<T>().insert(Position().set(code, WHITE, &st).material_key(), Ptr<T>(new Endgame<E>(WHITE)));
+    map<T>().insert(Position().set(code, BLACK, &st).material_key(), Ptr<T>(new Endgame<E>(BLACK)));
   }
 
   template<typename T>
   const EndgameBase<T>* probe(Key key) {
-    return map<T>().count(key) ? map<T>()[key].get() : nullptr;
+    return map<T>().probe(key);
   }
 }
 
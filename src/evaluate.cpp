@@ -21,7 +21,9 @@
 #include <algorithm>
 #include <cassert>
 #include <cstring>   // For std::memset
+#include <fstream>
 #include <iomanip>
+#include <iostream>
 #include <sstream>
 
 #include "bitboard.h"
@@ -29,6 +31,119 @@
 #include "material.h"
 #include "pawns.h"
 #include "thread.h"
+#include "uci.h"
+#include "incbin/incbin.h"
+
+
+// The default net is embedded in the binary with INCBIN, from the file given to
+// the Makefile as EVALFILE. Without it, or with MSVC which has no support for
+// INCBIN, a one byte placeholder stands in and the net is read from a file. The
+// copies of the dispatching build use the net embedded by dispatch.cpp.
+#if !defined(_MSC_VER) && !defined(NNUE_EMBEDDING_OFF)
+#  if defined(USE_DISPATCH)
+  INCBIN_EXTERN(EmbeddedNNUE);
+#  else
+  INCBIN(EmbeddedNNUE, EvalFileEmbedded);
+#  endif
+#else
+  const unsigned char        gEmbeddedNNUEData[1] = {0x0};
+  [[maybe_unused]]
+  const unsigned char *const gEmbeddedNNUEEnd = &gEmbeddedNNUEData[1];
+  const unsigned int         gEmbeddedNNUESize = 1;
+#endif
+
+
+namespace Eval {
+
+  bool useNNUE;
+  std::string eval_file_loaded = "None";
+
+  namespace {
+
+  // Reads the embedded net in place, as a stream
+  class MemoryBuffer : public std::basic_streambuf<char> {
+    public: MemoryBuffer(char* p, size_t n) { setg(p, p, p + n); setp(p, p + n); }
+  };
+
+  // The embedded net stands for an empty EvalFile or "<internal>", and for the
+  // default name, so that the default settings read no file at all
+  bool use_embedded(const std::string& evalFile) {
+
+    return   gEmbeddedNNUESize > 1
+          && (evalFile.empty() || evalFile == "<internal>" || evalFile == EvalFileDefaultName);
+  }
+
+  } // namespace
+
+  /// NNUE::init() is called when the "Use NNUE" or "EvalFile" option changes.
+  /// It loads the network named by EvalFile when NNUE is on, and falls back to
+  /// the classical evaluation with an error message when no usable net is found.
+  /// A file written by export_net is mapped in place, any other one is read as
+  /// a stream in the format of the trainer. The net embedded in the binary, if
+  /// any, is read from memory.
+
+  void NNUE::init() {
+
+    useNNUE = Options["Use NNUE"];
+    if (!useNNUE)
+        return;
+
+    std::string eval_file = std::string(Options["EvalFile"]);
+
+    if (eval_file_loaded != eval_file)
+    {
+        bool loaded;
+
+        if (use_embedded(eval_file))
+        {
+            MemoryBuffer buffer(const_cast<char*>(reinterpret_cast<const char*>(gEmbeddedNNUEData)),
+                                size_t(gEmbeddedNNUESize));
+            std::istream stream(&buffer);
+            loaded = load_eval(eval_file, stream);
+        }
+        else
+        {
+            std::ifstream stream(eval_file, std::ios::binary);
+            loaded = map_eval(eval_file) || load_eval(eval_file, stream);
+        }
+
+        // A failed read leaves no usable net
+        eval_file_loaded = loaded ? eval_file : "None";
+    }
+
+    if (eval_file_loaded != eval_file)
+    {
+        useNNUE = false;
+        sync_cout << "info string ERROR: the network file " << eval_file
+                  << " was not loaded successfully, using classical evaluation" << sync_endl;
+        return;
+    }
+
+    sync_cout << "info string NNUE evaluation using " << eval_file << " enabled" << sync_endl;
+  }
+
+  /// NNUE::export_net() writes the loaded network to a file that the next
+  /// engines load by mapping it: the parameters are stored as this build lays
+  /// them out in memory, so that no parsing or copying is needed, and all the
+  /// processes of a host share the same pages.
+
+  void NNUE::export_net(const std::string& filename) {
+
+    if (eval_file_loaded == "None")
+    {
+        sync_cout << "Failed to export a net. A network must be loaded first." << sync_endl;
+        return;
+    }
+
+    std::ofstream stream(filename, std::ios_base::binary);
+
+    if (save_mapped_eval(stream))
+        sync_cout << "Network saved successfully to " << filename << "." << sync_endl;
+    else
+        sync_cout << "Failed to export a net." << sync_endl;
+  }
+
+} // namespace Eval
 
 namespace Trace {
 
@@ -170,7 +285,7 @@ namespace {
     Score initiative(Value eg) const;
 
     const Position& pos;
-    Material::Entry* me;
+    const Material::Entry* me;
     Pawns::Entry* pe;
     Bitboard mobilityArea[COLOR_NB];
     Score mobility[COLOR_NB] = { SCORE_ZERO, SCORE_ZERO };
@@ -806,6 +921,17 @@ namespace {
 /// evaluation of the position from the point of view of the side to move.
 
 Value Eval::evaluate(const Position& pos) {
+
+  // Positions with a specialized endgame function keep the hand-written
+  // Makruk endgame knowledge (mating patterns, counting) even with NNUE on.
+  if (useNNUE && !Material::probe(pos)->specialized_eval_exists())
+  {
+      Value v = NNUE::evaluate(pos) + Tempo;
+
+      // Guarantee evaluation does not hit the mate range
+      return clamp(v, VALUE_MATED_IN_MAX_PLY + 1, VALUE_MATE_IN_MAX_PLY - 1);
+  }
+
   return Evaluation<NO_TRACE>(pos).value();
 }
 
@@ -847,5 +973,12 @@ std::string Eval::trace(const Position& pos) {
 
   ss << "\nTotal evaluation: " << to_cp(v) << " (white side)\n";
 
+  if (useNNUE)
+  {
+      v = NNUE::evaluate(pos);
+      v = pos.side_to_move() == WHITE ? v : -v;
+      ss << "NNUE evaluation:  " << to_cp(v) << " (white side)\n";
+  }
+
   return ss.str();
 }
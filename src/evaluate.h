@@ -21,7 +21,9 @@
 #ifndef EVALUATE_H_INCLUDED
 #define EVALUATE_H_INCLUDED
 
+#include <iosfwd>
 #include <string>
+#include <vector>
 
 #include "types.h"
 
@@ -34,6 +36,27 @@ constexpr Value Tempo = Value(28); // Must be visible to search
 std::string trace(const Position& pos);
 
 Value evaluate(const Position& pos);
-}
+
+extern bool useNNUE;
+extern std::string eval_file_loaded;
+
+// The network file looked up when "Use NNUE" is switched on. It is a HalfKP
+// net trained on Makruk positions with the Makruk piece ordering.
+#define EvalFileDefaultName "makruk.nnue"
+
+namespace NNUE {
+
+  Value evaluate(const Position& pos);
+  bool load_eval(std::string name, std::istream& stream);
+  bool map_eval(std::string name);
+  bool save_eval(std::ostream& stream);
+  bool save_mapped_eval(std::ostream& stream);
+  void init();
+  void export_net(const std::string& filename);
+  void time_first_layer(const std::vector<std::string>& fens, uint64_t iterations);
+
+} // namespace NNUE
+
+} // namespace Eval
 
 #endif // #ifndef EVALUATE_H_INCLUDED
@@ -21,6 +21,8 @@
 #include <iostream>
 
 #include "bitboard.h"
+#include "cluster.h"
+#include "material.h"
 #include "position.h"
 #include "search.h"
 #include "thread.h"
@@ -43,12 +45,14 @@ int main(int argc, char* argv[]) {
   Position::init();
   Bitbases::init();
   Endgames::init();
+  Material::init();
   Search::init();
   Threads.set(Options["Threads"]);
   Search::clear(); // After threads are up
 
   UCI::loop(argc, argv);
 
+  Cluster::connect(""); // Close the connections to the workers
   Threads.set(0);
   return 0;
 }
@@ -19,8 +19,12 @@
 */
 
 #include <algorithm> // For std::min
+#include <atomic>
 #include <cassert>
+#include <cstddef>   // For offsetof
+#include <cstdlib>   // For std::calloc
 #include <cstring>   // For std::memset
+#include <iostream>
 
 #include "material.h"
 #include "thread.h"
@@ -114,1048 +118,947 @@ namespace {
   Endgame<KRNQQKRB> EvaluateKRNQQKRB[] = { Endgame<KRNQQKRB>(WHITE), Endgame<KRNQQKRB>(BLACK) };
   Endgame<KRQKBQ>   EvaluateKRQKBQ[]   = { Endgame<KRQKBQ>(WHITE),   Endgame<KRQKBQ>(BLACK) };
   
+  // MaterialCount holds the piece counts of both sides. The endgame detection
+  // helpers below only look at these, so their verdict for a given material
+  // signature can be computed once at startup.
+  struct MaterialCount {
+
+    template<PieceType Pt> int count(Color c) const { return pieceCount[c][Pt]; }
+
+    Value non_pawn_material(Color c) const {
+      return  Value(  pieceCount[c][QUEEN ] * QueenValueMg
+                    + pieceCount[c][BISHOP] * BishopValueMg
+                    + pieceCount[c][KNIGHT] * KnightValueMg
+                    + pieceCount[c][ROOK  ] * RookValueMg);
+    }
+
+    bool bare_king(Color c) const {
+      return !pieceCount[c][PAWN] && !non_pawn_material(c);
+    }
+
+    int pieceCount[COLOR_NB][PIECE_TYPE_NB];
+  };
+
   // Helper used to detect a given material distribution redghost
-  bool is_KXK(const Position& pos, Color us) {
-    return  !more_than_one(pos.pieces(~us))
-          && (pos.count<PAWN>(us) || !pos.count<PAWN>(us))
-          && pos.non_pawn_material(us) >= BishopValueMg + QueenValueMg;
-  }
-
-  bool is_KQsPsK(const Position& pos, Color us) {
-    return   (pos.count<QUEEN >(us) || pos.count<PAWN>(us))
-          && !pos.count<ROOK  >(us)
-          && !pos.count<BISHOP>(us)
-          && !pos.count<KNIGHT>(us)
-          && (pos.count<PAWN>(~us) || !pos.count<PAWN>(~us))
-          && !pos.count<ROOK>(~us)
-          && !pos.count<BISHOP>(~us)
-          && !pos.count<KNIGHT>(~us)
-          && !pos.count<QUEEN>(~us);
-  }
-
-  bool is_KXKRR(const Position& pos, Color us) {
-    return   !pos.count<PAWN>(us)
-          && !pos.count<ROOK>(us)
-          && (pos.count<KNIGHT>(us) || !pos.count<KNIGHT>(us))
-          && (pos.count<BISHOP>(us) || !pos.count<BISHOP>(us))
-          && (pos.count<QUEEN>(us) || !pos.count<QUEEN>(us))
-          && !pos.count<PAWN>(~us)
-          && pos.count<ROOK>(~us) == 2
-          && !pos.count<BISHOP>(~us)
-          && !pos.count<KNIGHT>(~us)
-          && !pos.count<QUEEN>(~us)
-          && pos.non_pawn_material(us) - pos.non_pawn_material(~us) >= PawnValueMg;
-  }
-
-  bool is_KRXKRR(const Position& pos, Color us) {
-    return   !pos.count<PAWN>(us)
-          && pos.count<ROOK>(us) == 1
-          && (pos.count<KNIGHT>(us) || !pos.count<KNIGHT>(us))
-          && (pos.count<BISHOP>(us) || !pos.count<BISHOP>(us))
-          && (pos.count<QUEEN>(us) || !pos.count<QUEEN>(us))
-          && !pos.count<PAWN>(~us)
-          && pos.count<ROOK>(~us) == 2
-          && !pos.count<BISHOP>(~us)
-          && !pos.count<KNIGHT>(~us)
-          && !pos.count<QUEEN>(~us)
-          && pos.non_pawn_material(us) - pos.non_pawn_material(~us) >= PawnValueMg;
-  }
-
-  bool is_KRRKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + RookValueMg
-          && pos.count<ROOK>(us) == 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KRNBQKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + KnightValueMg + BishopValueMg + QueenValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<BISHOP>(us) == 1
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KRNNKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + KnightValueMg + KnightValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<KNIGHT>(us) == 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KRNBKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + KnightValueMg + BishopValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<BISHOP>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KRNQKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + KnightValueMg + QueenValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KRBBKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + BishopValueMg + BishopValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<BISHOP>(us) == 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KRBQKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + BishopValueMg + QueenValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<BISHOP>(us) == 1
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KRQQQKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + QueenValueMg + QueenValueMg + QueenValueMg
-          && pos.count<ROOK>(us) == 1
-          && !pos.count<KNIGHT>(us)
-          && !pos.count<BISHOP>(us)
-          && pos.count<QUEEN>(us) >= 3
-          && !pos.count<PAWN>(us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1
-          && !pos.count<BISHOP>(~us)
-          && !pos.count<KNIGHT>(~us)
-          && !pos.count<QUEEN>(~us)
-          && !pos.count<PAWN>(~us);
-  }
-
-  bool is_KRKQ(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg
-          && pos.count<ROOK>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == QueenValueMg
-          && pos.count<QUEEN>(~us) == 1;
-  }
-
-  bool is_KQQQKQ(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= QueenValueMg + QueenValueMg + QueenValueMg
-          && pos.count<QUEEN>(us) >= 3
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == QueenValueMg
-          && pos.count<QUEEN>(~us) == 1;
-  }
-
-  bool is_KBQKQ(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= BishopValueMg + QueenValueMg
-          && pos.count<BISHOP>(us) >= 1
-          && pos.count<QUEEN >(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == QueenValueMg
-          && pos.count<QUEEN>(~us) == 1;
-  }
-
-  bool is_KBBKQ(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= BishopValueMg + BishopValueMg
-          && pos.count<BISHOP>(us) == 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == QueenValueMg
-          && pos.count<QUEEN>(~us) == 1;
-  }
-
-  bool is_KNBQKQ(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + BishopValueMg + QueenValueMg
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<BISHOP>(us) == 1
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == QueenValueMg
-          && pos.count<QUEEN>(~us) == 1;
-  }
-
-  bool is_KNNQKQ(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + KnightValueMg + QueenValueMg
-          && pos.count<KNIGHT>(us) == 2
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == QueenValueMg
-          && pos.count<QUEEN>(~us) == 1;
-  }
-
-  bool is_KNQQKQ(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + QueenValueMg + QueenValueMg
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<QUEEN>(us) >= 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == QueenValueMg
-          && pos.count<QUEEN>(~us) == 1;
-  }
-
-  bool is_KNBKQ(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + BishopValueMg
-          && pos.count<KNIGHT>(us) >= 1
-          && pos.count<BISHOP>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == QueenValueMg
-          && pos.count<QUEEN>(~us) == 1;
-  }
-
-  bool is_KRKB(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg
-          && pos.count<ROOK>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == BishopValueMg
-          && pos.count<BISHOP>(~us) == 1;
-  }
-
-  bool is_KNBQKB(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + BishopValueMg + QueenValueMg
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<BISHOP>(us) == 1
-          && pos.count<QUEEN >(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == BishopValueMg
-          && pos.count<BISHOP>(~us) == 1;
-  }
-
-  bool is_KNQQKB(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + QueenValueMg + QueenValueMg
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<QUEEN>(us) >= 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == BishopValueMg
-          && pos.count<BISHOP>(~us) == 1;
-  }
-
-  bool is_KBQQKB(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= BishopValueMg + QueenValueMg + QueenValueMg
-          && pos.count<BISHOP>(us) == 1
-          && pos.count<QUEEN>(us) >= 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == BishopValueMg
-          && pos.count<BISHOP>(~us) == 1;
-  }
-
-  bool is_KNNQKB(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + KnightValueMg + QueenValueMg
-          && pos.count<KNIGHT>(us) == 2
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == BishopValueMg
-          && pos.count<BISHOP>(~us) == 1;
-  }
-
-  bool is_KBBQKB(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= BishopValueMg + BishopValueMg + QueenValueMg
-          && pos.count<BISHOP>(us) == 2
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == BishopValueMg
-          && pos.count<BISHOP>(~us) == 1;
-  }
-
-  bool is_KNBKB(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + BishopValueMg
-          && pos.count<KNIGHT>(us) >= 1
-          && pos.count<BISHOP>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == BishopValueMg
-          && pos.count<BISHOP>(~us) == 1;
-  }
-
-  bool is_KQQQQKB(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg
-          && pos.count<QUEEN>(us) >= 4
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == BishopValueMg
-          && pos.count<BISHOP>(~us) == 1;
-  }
-
-  bool is_KBQQQQKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= BishopValueMg + QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg
-          && pos.count<BISHOP>(us) == 1
-          && pos.count<QUEEN>(us) >= 4
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KBBQQKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= BishopValueMg + BishopValueMg + QueenValueMg + QueenValueMg
-          && pos.count<BISHOP>(us) == 2
-          && pos.count<QUEEN>(us) >= 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KNQQQQKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<QUEEN>(us) >= 4
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KNNQQKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + KnightValueMg + QueenValueMg + QueenValueMg
-          && pos.count<KNIGHT>(us) == 2
-          && pos.count<QUEEN>(us) >= 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KBBNKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + BishopValueMg + BishopValueMg
-          && pos.count<KNIGHT>(us) >= 1
-          && pos.count<BISHOP>(us) == 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KNBBQKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + BishopValueMg + BishopValueMg + QueenValueMg
-          && pos.count<KNIGHT>(us) >= 1
-          && pos.count<BISHOP>(us) == 2
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KNNBKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + KnightValueMg + BishopValueMg
-          && pos.count<KNIGHT>(us) == 2
-          && pos.count<BISHOP>(us) >= 1
-          && !pos.count<QUEEN>(us)
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KNNBQKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + KnightValueMg + BishopValueMg + QueenValueMg
-          && pos.count<KNIGHT>(us) == 2
-          && pos.count<BISHOP>(us) >= 1
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KNBQQKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + BishopValueMg + QueenValueMg + QueenValueMg
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<BISHOP>(us) == 1
-          && pos.count<QUEEN>(us) >= 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KQQQQQKR(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg
-          && pos.count<QUEEN>(us) >= 5
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg
-          && pos.count<ROOK>(~us) == 1;
-  }
-
-  bool is_KRNBQKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + KnightValueMg + BishopValueMg + QueenValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<BISHOP>(us) == 1
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KRNBKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + KnightValueMg + BishopValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<BISHOP>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KRNQKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + KnightValueMg + QueenValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KRBQKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + BishopValueMg + QueenValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<BISHOP>(us) == 1
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KRQKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + QueenValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KRBKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + BishopValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<BISHOP>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KRNKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + KnightValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<KNIGHT>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KRRKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + RookValueMg
-          && pos.count<ROOK>(us) == 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KBQQQKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= BishopValueMg + QueenValueMg + QueenValueMg + QueenValueMg
-          && pos.count<BISHOP>(us) == 1
-          && pos.count<QUEEN>(us) >= 3
-		  && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KNQQQKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + QueenValueMg + QueenValueMg + QueenValueMg
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<QUEEN>(us) >= 3
-		  && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KBBQKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= BishopValueMg + BishopValueMg + QueenValueMg
-          && pos.count<BISHOP>(us) == 2
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KNBQKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + BishopValueMg + QueenValueMg
-          && pos.count<BISHOP>(us) == 1
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KNNQQKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + KnightValueMg + QueenValueMg + QueenValueMg
-          && pos.count<KNIGHT>(us) == 2
-          && pos.count<QUEEN>(us) >= 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KNNBKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + KnightValueMg + BishopValueMg
-          && pos.count<KNIGHT>(us) == 2
-          && pos.count<BISHOP>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KNBBKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= KnightValueMg + BishopValueMg + BishopValueMg
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<BISHOP>(us) == 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KQQQQQKN(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg
-          && pos.count<QUEEN>(us) >= 5
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == KnightValueMg
-          && pos.count<KNIGHT>(~us) == 1;
-  }
-
-  bool is_KRNQKRQ(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + KnightValueMg + QueenValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg + QueenValueMg
-          && pos.count<ROOK>(~us) == 1
-          && pos.count<QUEEN>(~us) == 1;
-  }
-
-  bool is_KRBQQKRQ(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + BishopValueMg + QueenValueMg + QueenValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<BISHOP>(us) == 1
-          && pos.count<QUEEN>(us) >= 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg + QueenValueMg
-          && pos.count<ROOK>(~us) == 1
-          && pos.count<QUEEN>(~us) == 1;
-  }
-
-  bool is_KRNQQKRB(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + KnightValueMg + QueenValueMg + QueenValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<KNIGHT>(us) == 1
-          && pos.count<QUEEN>(us) >= 2
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == RookValueMg + BishopValueMg
-          && pos.count<ROOK>(~us) == 1
-          && pos.count<BISHOP>(~us) == 1;
-  }
-
-  bool is_KRQKBQ(const Position& pos, Color us) {
-    return   pos.non_pawn_material(us) >= RookValueMg + QueenValueMg
-          && pos.count<ROOK>(us) == 1
-          && pos.count<QUEEN>(us) >= 1
-          && !pos.count<PAWN>(~us)
-          && pos.non_pawn_material(~us) == BishopValueMg + QueenValueMg
-          && pos.count<BISHOP>(~us) == 1
-          && pos.count<QUEEN>(~us) == 1; // redghost
+  bool is_KXK(const MaterialCount& m, Color us) {
+    return   m.bare_king(~us)
+          && (m.count<PAWN>(us) || !m.count<PAWN>(us))
+          && m.non_pawn_material(us) >= BishopValueMg + QueenValueMg;
   }
 
-  /// imbalance() calculates the imbalance by comparing the piece count of each
-  /// piece type for both colors.
-  template<Color Us>
-  int imbalance(const int pieceCount[][PIECE_TYPE_NB]) {
+  bool is_KQsPsK(const MaterialCount& m, Color us) {
+    return   (m.count<QUEEN >(us) || m.count<PAWN>(us))
+          && !m.count<ROOK  >(us)
+          && !m.count<BISHOP>(us)
+          && !m.count<KNIGHT>(us)
+          && (m.count<PAWN>(~us) || !m.count<PAWN>(~us))
+          && !m.count<ROOK>(~us)
+          && !m.count<BISHOP>(~us)
+          && !m.count<KNIGHT>(~us)
+          && !m.count<QUEEN>(~us);
+  }
 
-    constexpr Color Them = (Us == WHITE ? BLACK : WHITE);
+  bool is_KXKRR(const MaterialCount& m, Color us) {
+    return   !m.count<PAWN>(us)
+          && !m.count<ROOK>(us)
+          && (m.count<KNIGHT>(us) || !m.count<KNIGHT>(us))
+          && (m.count<BISHOP>(us) || !m.count<BISHOP>(us))
+          && (m.count<QUEEN>(us) || !m.count<QUEEN>(us))
+          && !m.count<PAWN>(~us)
+          && m.count<ROOK>(~us) == 2
+          && !m.count<BISHOP>(~us)
+          && !m.count<KNIGHT>(~us)
+          && !m.count<QUEEN>(~us)
+          && m.non_pawn_material(us) - m.non_pawn_material(~us) >= PawnValueMg;
+  }
 
-    int bonus = 0;
+  bool is_KRXKRR(const MaterialCount& m, Color us) {
+    return   !m.count<PAWN>(us)
+          && m.count<ROOK>(us) == 1
+          && (m.count<KNIGHT>(us) || !m.count<KNIGHT>(us))
+          && (m.count<BISHOP>(us) || !m.count<BISHOP>(us))
+          && (m.count<QUEEN>(us) || !m.count<QUEEN>(us))
+          && !m.count<PAWN>(~us)
+          && m.count<ROOK>(~us) == 2
+          && !m.count<BISHOP>(~us)
+          && !m.count<KNIGHT>(~us)
+          && !m.count<QUEEN>(~us)
+          && m.non_pawn_material(us) - m.non_pawn_material(~us) >= PawnValueMg;
+  }
 
-    // Second-degree polynomial material imbalance, by Tord Romstad
-    for (int pt1 = NO_PIECE_TYPE; pt1 <= ROOK; ++pt1)
-    {
-        if (!pieceCount[Us][pt1])
-            continue;
+  bool is_KRRKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + RookValueMg
+          && m.count<ROOK>(us) == 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-        int v = 0;
+  bool is_KRNBQKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + KnightValueMg + BishopValueMg + QueenValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<KNIGHT>(us) == 1
+          && m.count<BISHOP>(us) == 1
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-        for (int pt2 = NO_PIECE_TYPE; pt2 <= pt1; ++pt2)
-            v +=  QuadraticOurs[pt1][pt2] * pieceCount[Us][pt2]
-                + QuadraticTheirs[pt1][pt2] * pieceCount[Them][pt2];
+  bool is_KRNNKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + KnightValueMg + KnightValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<KNIGHT>(us) == 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-        bonus += pieceCount[Us][pt1] * v;
-    }
+  bool is_KRNBKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + KnightValueMg + BishopValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<KNIGHT>(us) == 1
+          && m.count<BISHOP>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-    return bonus;
+  bool is_KRNQKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + KnightValueMg + QueenValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<KNIGHT>(us) == 1
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
   }
 
-} // namespace
+  bool is_KRBBKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + BishopValueMg + BishopValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<BISHOP>(us) == 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-namespace Material {
+  bool is_KRBQKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + BishopValueMg + QueenValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<BISHOP>(us) == 1
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-/// Material::probe() looks up the current position's material configuration in
-/// the material hash table. It returns a pointer to the Entry if the position
-/// is found. Otherwise a new Entry is computed and stored there, so we don't
-/// have to recompute all when the same material configuration occurs again.
+  bool is_KRQQQKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + QueenValueMg + QueenValueMg + QueenValueMg
+          && m.count<ROOK>(us) == 1
+          && !m.count<KNIGHT>(us)
+          && !m.count<BISHOP>(us)
+          && m.count<QUEEN>(us) >= 3
+          && !m.count<PAWN>(us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1
+          && !m.count<BISHOP>(~us)
+          && !m.count<KNIGHT>(~us)
+          && !m.count<QUEEN>(~us)
+          && !m.count<PAWN>(~us);
+  }
 
-Entry* probe(const Position& pos) {
+  bool is_KRKQ(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg
+          && m.count<ROOK>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == QueenValueMg
+          && m.count<QUEEN>(~us) == 1;
+  }
 
-  Key key = pos.material_key();
-  Entry* e = pos.this_thread()->materialTable[key];
+  bool is_KQQQKQ(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= QueenValueMg + QueenValueMg + QueenValueMg
+          && m.count<QUEEN>(us) >= 3
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == QueenValueMg
+          && m.count<QUEEN>(~us) == 1;
+  }
 
-  if (e->key == key)
-      return e;
+  bool is_KBQKQ(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= BishopValueMg + QueenValueMg
+          && m.count<BISHOP>(us) >= 1
+          && m.count<QUEEN >(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == QueenValueMg
+          && m.count<QUEEN>(~us) == 1;
+  }
 
-  std::memset(e, 0, sizeof(Entry));
-  e->key = key;
-  e->factor[WHITE] = e->factor[BLACK] = (uint8_t)SCALE_FACTOR_NORMAL;
+  bool is_KBBKQ(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= BishopValueMg + BishopValueMg
+          && m.count<BISHOP>(us) == 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == QueenValueMg
+          && m.count<QUEEN>(~us) == 1;
+  }
 
-  Value npm_w = pos.non_pawn_material(WHITE);
-  Value npm_b = pos.non_pawn_material(BLACK);
-  Value npm   = clamp(npm_w + npm_b, EndgameLimit, MidgameLimit);
+  bool is_KNBQKQ(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + BishopValueMg + QueenValueMg
+          && m.count<KNIGHT>(us) == 1
+          && m.count<BISHOP>(us) == 1
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == QueenValueMg
+          && m.count<QUEEN>(~us) == 1;
+  }
 
-  // Map total non-pawn material into [PHASE_ENDGAME, PHASE_MIDGAME]
-  e->gamePhase = Phase(((npm - EndgameLimit) * PHASE_MIDGAME) / (MidgameLimit - EndgameLimit));
+  bool is_KNNQKQ(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + KnightValueMg + QueenValueMg
+          && m.count<KNIGHT>(us) == 2
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == QueenValueMg
+          && m.count<QUEEN>(~us) == 1;
+  }
 
-  // Let's look if we have a specialized evaluation function for this particular
-  // material configuration. Firstly we look for a fixed configuration one, then
-  // for a generic one if the previous search failed.
-  if ((e->evaluationFunction = Endgames::probe<Value>(key)) != nullptr)
-      return e;
+  bool is_KNQQKQ(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + QueenValueMg + QueenValueMg
+          && m.count<KNIGHT>(us) == 1
+          && m.count<QUEEN>(us) >= 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == QueenValueMg
+          && m.count<QUEEN>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KXK(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKXK[c];
-          return e;
-      }
+  bool is_KNBKQ(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + BishopValueMg
+          && m.count<KNIGHT>(us) >= 1
+          && m.count<BISHOP>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == QueenValueMg
+          && m.count<QUEEN>(~us) == 1;
+  }
 
-  // Only queens and pawns against bare king
-  for (Color c : { WHITE, BLACK })
-      if (is_KQsPsK(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKQsPsK[c];
-          return e;
-      }
+  bool is_KRKB(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg
+          && m.count<ROOK>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == BishopValueMg
+          && m.count<BISHOP>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KXKRR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKXKRR[c];
-          return e;
-      }
+  bool is_KNBQKB(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + BishopValueMg + QueenValueMg
+          && m.count<KNIGHT>(us) == 1
+          && m.count<BISHOP>(us) == 1
+          && m.count<QUEEN >(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == BishopValueMg
+          && m.count<BISHOP>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRXKRR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRXKRR[c];
-          return e;
-      }
+  bool is_KNQQKB(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + QueenValueMg + QueenValueMg
+          && m.count<KNIGHT>(us) == 1
+          && m.count<QUEEN>(us) >= 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == BishopValueMg
+          && m.count<BISHOP>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRRKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRRKR[c];
-          return e;
-      }
+  bool is_KBQQKB(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= BishopValueMg + QueenValueMg + QueenValueMg
+          && m.count<BISHOP>(us) == 1
+          && m.count<QUEEN>(us) >= 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == BishopValueMg
+          && m.count<BISHOP>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRNBQKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRNBQKR[c];
-          return e;
-      }
+  bool is_KNNQKB(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + KnightValueMg + QueenValueMg
+          && m.count<KNIGHT>(us) == 2
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == BishopValueMg
+          && m.count<BISHOP>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRNNKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRNNKR[c];
-          return e;
-      }
+  bool is_KBBQKB(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= BishopValueMg + BishopValueMg + QueenValueMg
+          && m.count<BISHOP>(us) == 2
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == BishopValueMg
+          && m.count<BISHOP>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRNBKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRNBKR[c];
-          return e;
-       }
+  bool is_KNBKB(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + BishopValueMg
+          && m.count<KNIGHT>(us) >= 1
+          && m.count<BISHOP>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == BishopValueMg
+          && m.count<BISHOP>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRNQKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRNQKR[c];
-          return e;
-      }
+  bool is_KQQQQKB(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg
+          && m.count<QUEEN>(us) >= 4
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == BishopValueMg
+          && m.count<BISHOP>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRBBKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRBBKR[c];
-          return e;
-      }
+  bool is_KBQQQQKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= BishopValueMg + QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg
+          && m.count<BISHOP>(us) == 1
+          && m.count<QUEEN>(us) >= 4
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRBQKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRBQKR[c];
-          return e;
-      }
+  bool is_KBBQQKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= BishopValueMg + BishopValueMg + QueenValueMg + QueenValueMg
+          && m.count<BISHOP>(us) == 2
+          && m.count<QUEEN>(us) >= 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRQQQKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRQQQKR[c];
-          return e;
-      }
+  bool is_KNQQQQKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg
+          && m.count<KNIGHT>(us) == 1
+          && m.count<QUEEN>(us) >= 4
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRKQ(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRKQ[c];
-          return e;
-      }
+  bool is_KNNQQKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + KnightValueMg + QueenValueMg + QueenValueMg
+          && m.count<KNIGHT>(us) == 2
+          && m.count<QUEEN>(us) >= 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KQQQKQ(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKQQQKQ[c];
-          return e;
-      }
+  bool is_KBBNKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + BishopValueMg + BishopValueMg
+          && m.count<KNIGHT>(us) >= 1
+          && m.count<BISHOP>(us) == 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KBQKQ(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKBQKQ[c];
-          return e;
-      }
+  bool is_KNBBQKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + BishopValueMg + BishopValueMg + QueenValueMg
+          && m.count<KNIGHT>(us) >= 1
+          && m.count<BISHOP>(us) == 2
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KBBKQ(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKBBKQ[c];
-          return e;
-      }
+  bool is_KNNBKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + KnightValueMg + BishopValueMg
+          && m.count<KNIGHT>(us) == 2
+          && m.count<BISHOP>(us) >= 1
+          && !m.count<QUEEN>(us)
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNBQKQ(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNBQKQ[c];
-          return e;
-      }
+  bool is_KNNBQKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + KnightValueMg + BishopValueMg + QueenValueMg
+          && m.count<KNIGHT>(us) == 2
+          && m.count<BISHOP>(us) >= 1
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNNQKQ(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNNQKQ[c];
-          return e;
-      }
+  bool is_KNBQQKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + BishopValueMg + QueenValueMg + QueenValueMg
+          && m.count<KNIGHT>(us) == 1
+          && m.count<BISHOP>(us) == 1
+          && m.count<QUEEN>(us) >= 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNQQKQ(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNQQKQ[c];
-          return e;
-      }
+  bool is_KQQQQQKR(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg
+          && m.count<QUEEN>(us) >= 5
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg
+          && m.count<ROOK>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNBKQ(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNBKQ[c];
-          return e;
-      }
+  bool is_KRNBQKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + KnightValueMg + BishopValueMg + QueenValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<KNIGHT>(us) == 1
+          && m.count<BISHOP>(us) == 1
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRKB(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRKB[c];
-          return e;
-      }
+  bool is_KRNBKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + KnightValueMg + BishopValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<KNIGHT>(us) == 1
+          && m.count<BISHOP>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNBQKB(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNBQKB[c];
-          return e;
-      }
+  bool is_KRNQKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + KnightValueMg + QueenValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<KNIGHT>(us) == 1
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNQQKB(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNQQKB[c];
-          return e;
-      }
+  bool is_KRBQKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + BishopValueMg + QueenValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<BISHOP>(us) == 1
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KBQQKB(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKBQQKB[c];
-          return e;
-      }
+  bool is_KRQKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + QueenValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNNQKB(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNNQKB[c];
-          return e;
-      }
+  bool is_KRBKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + BishopValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<BISHOP>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KBBQKB(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKBBQKB[c];
-          return e;
-      }
+  bool is_KRNKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + KnightValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<KNIGHT>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNBKB(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNBKB[c];
-          return e;
-      }
+  bool is_KRRKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + RookValueMg
+          && m.count<ROOK>(us) == 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KQQQQKB(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKQQQQKB[c];
-          return e;
-      }
+  bool is_KBQQQKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= BishopValueMg + QueenValueMg + QueenValueMg + QueenValueMg
+          && m.count<BISHOP>(us) == 1
+          && m.count<QUEEN>(us) >= 3
+		  && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KBQQQQKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKBQQQQKR[c];
-          return e;
-      }
+  bool is_KNQQQKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + QueenValueMg + QueenValueMg + QueenValueMg
+          && m.count<KNIGHT>(us) == 1
+          && m.count<QUEEN>(us) >= 3
+		  && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KBBQQKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKBBQQKR[c];
-          return e;
-      }
+  bool is_KBBQKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= BishopValueMg + BishopValueMg + QueenValueMg
+          && m.count<BISHOP>(us) == 2
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNQQQQKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNQQQQKR[c];
-          return e;
-      }
+  bool is_KNBQKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + BishopValueMg + QueenValueMg
+          && m.count<BISHOP>(us) == 1
+          && m.count<KNIGHT>(us) == 1
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNNQQKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNNQQKR[c];
-          return e;
-      }
+  bool is_KNNQQKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + KnightValueMg + QueenValueMg + QueenValueMg
+          && m.count<KNIGHT>(us) == 2
+          && m.count<QUEEN>(us) >= 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KBBNKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKBBNKR[c];
-          return e;
-      }
+  bool is_KNNBKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + KnightValueMg + BishopValueMg
+          && m.count<KNIGHT>(us) == 2
+          && m.count<BISHOP>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNBBQKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNBBQKR[c];
-          return e;
-      }
+  bool is_KNBBKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= KnightValueMg + BishopValueMg + BishopValueMg
+          && m.count<KNIGHT>(us) == 1
+          && m.count<BISHOP>(us) == 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNNBKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNNBKR[c];
-          return e;
-      }
+  bool is_KQQQQQKN(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg + QueenValueMg
+          && m.count<QUEEN>(us) >= 5
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == KnightValueMg
+          && m.count<KNIGHT>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNNBQKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNNBQKR[c];
-          return e;
-      }
+  bool is_KRNQKRQ(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + KnightValueMg + QueenValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<KNIGHT>(us) == 1
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg + QueenValueMg
+          && m.count<ROOK>(~us) == 1
+          && m.count<QUEEN>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNBQQKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNBQQKR[c];
-          return e;
-      }
+  bool is_KRBQQKRQ(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + BishopValueMg + QueenValueMg + QueenValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<BISHOP>(us) == 1
+          && m.count<QUEEN>(us) >= 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg + QueenValueMg
+          && m.count<ROOK>(~us) == 1
+          && m.count<QUEEN>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KQQQQQKR(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKQQQQQKR[c];
-          return e;
-      }
+  bool is_KRNQQKRB(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + KnightValueMg + QueenValueMg + QueenValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<KNIGHT>(us) == 1
+          && m.count<QUEEN>(us) >= 2
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == RookValueMg + BishopValueMg
+          && m.count<ROOK>(~us) == 1
+          && m.count<BISHOP>(~us) == 1;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRNBQKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRNBQKN[c];
-          return e;
-      }
+  bool is_KRQKBQ(const MaterialCount& m, Color us) {
+    return   m.non_pawn_material(us) >= RookValueMg + QueenValueMg
+          && m.count<ROOK>(us) == 1
+          && m.count<QUEEN>(us) >= 1
+          && !m.count<PAWN>(~us)
+          && m.non_pawn_material(~us) == BishopValueMg + QueenValueMg
+          && m.count<BISHOP>(~us) == 1
+          && m.count<QUEEN>(~us) == 1; // redghost
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRNBKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRNBKN[c];
-          return e;
-      }
+  // Generic endgames in the order they are tried: the first pattern that matches
+  // for either color, white first, selects the evaluation function. In all of
+  // them the weak side has at most two pieces besides king and pawns.
+  struct GenericEndgame {
+    bool (*detect)(const MaterialCount&, Color);
+    const EndgameBase<Value>* eval[COLOR_NB];
+  };
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRNQKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRNQKN[c];
-          return e;
-      }
+  template<EndgameCode E>
+  constexpr GenericEndgame generic(bool (*detect)(const MaterialCount&, Color), const Endgame<E>* eg) {
+    return { detect, { &eg[WHITE], &eg[BLACK] } };
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRBQKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRBQKN[c];
-          return e;
-      }
+  const GenericEndgame GenericEndgames[] = {
+    generic(is_KXK,      EvaluateKXK),
+    generic(is_KQsPsK,   EvaluateKQsPsK), // Only queens and pawns against bare king
+    generic(is_KXKRR,    EvaluateKXKRR),
+    generic(is_KRXKRR,   EvaluateKRXKRR),
+    generic(is_KRRKR,    EvaluateKRRKR),
+    generic(is_KRNBQKR,  EvaluateKRNBQKR),
+    generic(is_KRNNKR,   EvaluateKRNNKR),
+    generic(is_KRNBKR,   EvaluateKRNBKR),
+    generic(is_KRNQKR,   EvaluateKRNQKR),
+    generic(is_KRBBKR,   EvaluateKRBBKR),
+    generic(is_KRBQKR,   EvaluateKRBQKR),
+    generic(is_KRQQQKR,  EvaluateKRQQQKR),
+    generic(is_KRKQ,     EvaluateKRKQ),
+    generic(is_KQQQKQ,   EvaluateKQQQKQ),
+    generic(is_KBQKQ,    EvaluateKBQKQ),
+    generic(is_KBBKQ,    EvaluateKBBKQ),
+    generic(is_KNBQKQ,   EvaluateKNBQKQ),
+    generic(is_KNNQKQ,   EvaluateKNNQKQ),
+    generic(is_KNQQKQ,   EvaluateKNQQKQ),
+    generic(is_KNBKQ,    EvaluateKNBKQ),
+    generic(is_KRKB,     EvaluateKRKB),
+    generic(is_KNBQKB,   EvaluateKNBQKB),
+    generic(is_KNQQKB,   EvaluateKNQQKB),
+    generic(is_KBQQKB,   EvaluateKBQQKB),
+    generic(is_KNNQKB,   EvaluateKNNQKB),
+    generic(is_KBBQKB,   EvaluateKBBQKB),
+    generic(is_KNBKB,    EvaluateKNBKB),
+    generic(is_KQQQQKB,  EvaluateKQQQQKB),
+    generic(is_KBQQQQKR, EvaluateKBQQQQKR),
+    generic(is_KBBQQKR,  EvaluateKBBQQKR),
+    generic(is_KNQQQQKR, EvaluateKNQQQQKR),
+    generic(is_KNNQQKR,  EvaluateKNNQQKR),
+    generic(is_KBBNKR,   EvaluateKBBNKR),
+    generic(is_KNBBQKR,  EvaluateKNBBQKR),
+    generic(is_KNNBKR,   EvaluateKNNBKR),
+    generic(is_KNNBQKR,  EvaluateKNNBQKR),
+    generic(is_KNBQQKR,  EvaluateKNBQQKR),
+    generic(is_KQQQQQKR, EvaluateKQQQQQKR),
+    generic(is_KRNBQKN,  EvaluateKRNBQKN),
+    generic(is_KRNBKN,   EvaluateKRNBKN),
+    generic(is_KRNQKN,   EvaluateKRNQKN),
+    generic(is_KRBQKN,   EvaluateKRBQKN),
+    generic(is_KRQKN,    EvaluateKRQKN),
+    generic(is_KRBKN,    EvaluateKRBKN),
+    generic(is_KRNKN,    EvaluateKRNKN),
+    generic(is_KRRKN,    EvaluateKRRKN),
+    generic(is_KBQQQKN,  EvaluateKBQQQKN),
+    generic(is_KNQQQKN,  EvaluateKNQQQKN),
+    generic(is_KBBQKN,   EvaluateKBBQKN),
+    generic(is_KNBQKN,   EvaluateKNBQKN),
+    generic(is_KNNQQKN,  EvaluateKNNQQKN),
+    generic(is_KNNBKN,   EvaluateKNNBKN),
+    generic(is_KNBBKN,   EvaluateKNBBKN),
+    generic(is_KQQQQQKN, EvaluateKQQQQQKN),
+    generic(is_KRNQKRQ,  EvaluateKRNQKRQ),
+    generic(is_KRBQQKRQ, EvaluateKRBQQKRQ),
+    generic(is_KRNQQKRB, EvaluateKRNQQKRB),
+    generic(is_KRQKBQ,   EvaluateKRQKBQ)
+  };
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRQKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRQKN[c];
-          return e;
-      }
+  constexpr int GenericEndgameNb = sizeof(GenericEndgames) / sizeof(GenericEndgame);
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRBKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRBKN[c];
-          return e;
-      }
+  static_assert(2 * GenericEndgameNb < 256, "Generic endgame index must fit in a byte");
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRNKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRNKN[c];
-          return e;
-      }
+  // Per side material signature: pawns only matter as present or not, queens
+  // go up to the 1 + 8 promoted of a legal game and minor pieces and rooks up
+  // to the initial two. This gives 2 * 10 * 3 * 3 * 3 = 540 signatures per side.
+  constexpr int MaxQueens = 9, MaxOthers = 2;
+  constexpr int SignatureNb = 2 * (MaxQueens + 1) * (MaxOthers + 1) * (MaxOthers + 1) * (MaxOthers + 1);
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRRKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRRKN[c];
-          return e;
-      }
+  // GenericIndex[] maps the signatures of both sides to 0 if no generic endgame
+  // applies, or to 1 + 2 * i + c for GenericEndgames[i] with strong side c.
+  uint8_t GenericIndex[SignatureNb][SignatureNb];
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KBQQQKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKBQQQKN[c];
-          return e;
-      }
+  int signature(const MaterialCount& m, Color c) {
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNQQQKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNQQQKN[c];
-          return e;
-      }
+    if (   m.count<QUEEN >(c) > MaxQueens
+        || m.count<BISHOP>(c) > MaxOthers
+        || m.count<KNIGHT>(c) > MaxOthers
+        || m.count<ROOK  >(c) > MaxOthers)
+        return -1;
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KBBQKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKBBQKN[c];
-          return e;
-      }
+    return  !!m.count<PAWN>(c)
+          + 2 * (m.count<QUEEN>(c) + (MaxQueens + 1) * (m.count<BISHOP>(c)
+          + (MaxOthers + 1) * (m.count<KNIGHT>(c) + (MaxOthers + 1) * m.count<ROOK>(c))));
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNBQKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNBQKN[c];
-          return e;
-      }
+  int generic_index(const MaterialCount& m) {
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNNQQKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNNQQKN[c];
-          return e;
-      }
+    for (int i = 0; i < GenericEndgameNb; ++i)
+        for (Color c : { WHITE, BLACK })
+            if (GenericEndgames[i].detect(m, c))
+                return 1 + 2 * i + c;
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNNBKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNNBKN[c];
-          return e;
-      }
+    return 0;
+  }
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KNBBKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKNBBKN[c];
-          return e;
-      }
+  /// imbalance() calculates the imbalance by comparing the piece count of each
+  /// piece type for both colors.
+  template<Color Us>
+  int imbalance(const int pieceCount[][PIECE_TYPE_NB]) {
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KQQQQQKN(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKQQQQQKN[c];
-          return e;
-      }
+    constexpr Color Them = (Us == WHITE ? BLACK : WHITE);
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRNQKRQ(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRNQKRQ[c];
-          return e;
-      }
+    int bonus = 0;
 
-  for (Color c : { WHITE, BLACK })
-      if (is_KRBQQKRQ(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRBQQKRQ[c];
-          return e;
-      }
+    // Second-degree polynomial material imbalance, by Tord Romstad
+    for (int pt1 = NO_PIECE_TYPE; pt1 <= ROOK; ++pt1)
+    {
+        if (!pieceCount[Us][pt1])
+            continue;
+
+        int v = 0;
+
+        for (int pt2 = NO_PIECE_TYPE; pt2 <= pt1; ++pt2)
+            v +=  QuadraticOurs[pt1][pt2] * pieceCount[Us][pt2]
+                + QuadraticTheirs[pt1][pt2] * pieceCount[Them][pt2];
+
+        bonus += pieceCount[Us][pt1] * v;
+    }
+
+    return bonus;
+  }
+
+} // namespace
+
+namespace Material {
+
+std::vector<const EndgameBase<Value>*> EvaluationFunctions;
+std::vector<const EndgameBase<ScaleFactor>*> ScalingFunctions;
+
+} // namespace Material
+
+namespace {
+
+  using Material::Entry;
+  using Material::EvaluationFunctions;
+  using Material::ScalingFunctions;
+
+  // Every reachable Makruk material configuration: per side at most 8 pawns,
+  // the Met plus one promoted Met for each missing pawn, and up to 2 Khon, Ma
+  // and Rua. Pawns and queens share a triangular index.
+  constexpr int MaxPawns = 8;
+  constexpr int PawnQueenNb = 54; // Sum of MaxQueens + 1 - p for p = 0..8
+  constexpr int SideNb = PawnQueenNb * (MaxOthers + 1) * (MaxOthers + 1) * (MaxOthers + 1);
+
+  int PawnQueenIndex[MaxPawns + 1][MaxQueens + 1];
+
+  // Registered endgames follow the generic ones in EvaluationFunctions[]
+  constexpr int FirstRegistered = 1 + 2 * GenericEndgameNb;
+
+  // The table holds the entries packed in one word each, filled the first time
+  // the material is probed. The gamePhase byte, at most PHASE_MIDGAME, is stored
+  // complemented so that a zero word marks an entry not computed yet.
+  constexpr uint64_t Complement = uint64_t(0xFF) << (8 * offsetof(Entry, gamePhase));
+
+  std::atomic<uint64_t>* Table;
+
+  // side_index() returns the index of a side's material in the table, or -1
+  // if it cannot be reached from the initial position.
+  int side_index(const int count[]) {
+
+    int p = count[PAWN], q = count[QUEEN], b = count[BISHOP], n = count[KNIGHT], r = count[ROOK];
+
+    if (   p > MaxPawns || q > MaxQueens || PawnQueenIndex[p][q] < 0
+        || b > MaxOthers || n > MaxOthers || r > MaxOthers)
+        return -1;
+
+    return PawnQueenIndex[p][q] + PawnQueenNb * (b + (MaxOthers + 1) * (n + (MaxOthers + 1) * r));
+  }
+
+  // compute() fills an Entry for the given piece counts and material key
+  void compute(Entry* e, const MaterialCount& m, Key key) {
+
+    std::memset(e, 0, sizeof(Entry));
+    e->factor[WHITE] = e->factor[BLACK] = (uint8_t)SCALE_FACTOR_NORMAL;
+
+    Value npm = ::clamp(m.non_pawn_material(WHITE) + m.non_pawn_material(BLACK),
+                        EndgameLimit, MidgameLimit);
+
+    // Map total non-pawn material into [PHASE_ENDGAME, PHASE_MIDGAME]
+    e->gamePhase = uint8_t(((npm - EndgameLimit) * PHASE_MIDGAME) / (MidgameLimit - EndgameLimit));
+
+    // Let's look if we have a specialized evaluation function for this particular
+    // material configuration. Firstly we look for a fixed configuration one.
+    int i = Endgames::map<Value>().index(key);
+    if (i >= 0)
+    {
+        e->evaluationFunction = uint16_t(FirstRegistered + i);
+        return;
+    }
+
+    // Then for a generic one, whose index in EvaluationFunctions[] is the same
+    // as in GenericIndex[].
+    int sw = signature(m, WHITE), sb = signature(m, BLACK);
+    if ((e->evaluationFunction = uint16_t(sw >= 0 && sb >= 0 ? GenericIndex[sw][sb]
+                                                             : generic_index(m))) != 0)
+        return;
+
+    // OK, we didn't find any special evaluation function for the current material
+    // configuration. Is there a suitable specialized scaling function?
+    i = Endgames::map<ScaleFactor>().index(key);
+    if (i >= 0)
+    {
+        e->scalingFunction = uint8_t(1 + i); // Only strong color assigned
+        return;
+    }
+
+    // Evaluate the material imbalance. We use PIECE_TYPE_NONE as a place holder
+    // for the bishop pair "extended piece", which allows us to be more flexible
+    // in defining bishop pair bonuses.
+    const int pieceCount[COLOR_NB][PIECE_TYPE_NB] = {
+    { m.count<QUEEN >(WHITE) > 1, m.count<PAWN  >(WHITE), m.count<QUEEN>(WHITE),
+      m.count<BISHOP>(WHITE)    , m.count<KNIGHT>(WHITE), m.count<ROOK >(WHITE) },
+    { m.count<QUEEN >(BLACK) > 1, m.count<PAWN  >(BLACK), m.count<QUEEN>(BLACK),
+      m.count<BISHOP>(BLACK)    , m.count<KNIGHT>(BLACK), m.count<ROOK >(BLACK) } };
+
+    e->value = int16_t((imbalance<WHITE>(pieceCount) - imbalance<BLACK>(pieceCount)) / 16);
+  }
+
+} // namespace
+
+namespace Material {
+
+/// Material::init() sets up the material table shared by all threads. It has
+/// an Entry for every pair of reachable material signatures, each computed the
+/// first time it is probed. Must be called after Endgames::init().
+
+void init() {
+
+  MaterialCount m;
 
   for (Color c : { WHITE, BLACK })
-      if (is_KRNQQKRB(pos, c))
+  {
+      m.pieceCount[c][NO_PIECE_TYPE] = 0;
+      m.pieceCount[c][KING] = 1;
+  }
+
+  // The generic endgames, which compute() looks up by material signature
+  for (int r1 = 0; r1 <= MaxOthers; ++r1)
+  for (int n1 = 0; n1 <= MaxOthers; ++n1)
+  for (int b1 = 0; b1 <= MaxOthers; ++b1)
+  for (int q1 = 0; q1 <= MaxQueens; ++q1)
+  for (int p1 = 0; p1 <= 1; ++p1)
+  {
+      m.pieceCount[WHITE][PAWN  ] = p1;
+      m.pieceCount[WHITE][QUEEN ] = q1;
+      m.pieceCount[WHITE][BISHOP] = b1;
+      m.pieceCount[WHITE][KNIGHT] = n1;
+      m.pieceCount[WHITE][ROOK  ] = r1;
+
+      for (int r2 = 0; r2 <= MaxOthers; ++r2)
+      for (int n2 = 0; n2 <= MaxOthers; ++n2)
+      for (int b2 = 0; b2 <= MaxOthers; ++b2)
+      for (int q2 = 0; q2 <= MaxQueens; ++q2)
+      for (int p2 = 0; p2 <= 1; ++p2)
       {
-          e->evaluationFunction = &EvaluateKRNQQKRB[c];
-          return e;
+          // No generic endgame has a weak side with more than two pieces
+          if (q1 + b1 + n1 + r1 > 2 && q2 + b2 + n2 + r2 > 2)
+              continue;
+
+          m.pieceCount[BLACK][PAWN  ] = p2;
+          m.pieceCount[BLACK][QUEEN ] = q2;
+          m.pieceCount[BLACK][BISHOP] = b2;
+          m.pieceCount[BLACK][KNIGHT] = n2;
+          m.pieceCount[BLACK][ROOK  ] = r2;
+
+          GenericIndex[signature(m, WHITE)][signature(m, BLACK)] = uint8_t(generic_index(m));
       }
+  }
+
+  // Index 0 stands for no function, followed by the generic endgames and then
+  // by the ones registered for a fixed material configuration.
+  EvaluationFunctions.assign(1, nullptr);
+  ScalingFunctions.assign(1, nullptr);
+
+  for (const GenericEndgame& g : GenericEndgames)
+      for (Color c : { WHITE, BLACK })
+          EvaluationFunctions.push_back(g.eval[c]);
+
+  assert(EvaluationFunctions.size() == FirstRegistered);
+
+  for (size_t i = 0; i < Endgames::map<Value>().size(); ++i)
+      EvaluationFunctions.push_back(Endgames::map<Value>()[i]);
+
+  for (size_t i = 0; i < Endgames::map<ScaleFactor>().size(); ++i)
+      ScalingFunctions.push_back(Endgames::map<ScaleFactor>()[i]);
+
+  assert(EvaluationFunctions.size() <= 65536 && ScalingFunctions.size() <= 256);
+
+  // Enumerate the reachable material of one side
+  for (int p = 0, i = 0; p <= MaxPawns; ++p)
+      for (int q = 0; q <= MaxQueens; ++q)
+          PawnQueenIndex[p][q] = p + q <= MaxQueens ? i++ : -1;
+
+  // calloc() gets zeroed pages that the OS maps on first touch, so a process
+  // pays only for the material its searches reach.
+  static_assert(sizeof(std::atomic<uint64_t>) == sizeof(Entry), "Unexpected table word size");
+
+  Table = static_cast<std::atomic<uint64_t>*>(std::calloc(size_t(SideNb) * SideNb, sizeof(Entry)));
+
+  if (!Table)
+  {
+      std::cerr << "Failed to allocate the material table" << std::endl;
+      exit(EXIT_FAILURE);
+  }
+}
+
+
+/// Material::probe() returns the Entry of the current position's material
+/// configuration, copied into a per thread Entry. Unreachable configurations,
+/// which can only come from a set up position, are computed on every probe.
+
+const Entry* probe(const Position& pos) {
+
+  MaterialCount m = {};
 
   for (Color c : { WHITE, BLACK })
-      if (is_KRQKBQ(pos, c))
-      {
-          e->evaluationFunction = &EvaluateKRQKBQ[c];
-          return e;
-     }
+  {
+      m.pieceCount[c][PAWN  ] = pos.count<PAWN  >(c);
+      m.pieceCount[c][QUEEN ] = pos.count<QUEEN >(c);
+      m.pieceCount[c][BISHOP] = pos.count<BISHOP>(c);
+      m.pieceCount[c][KNIGHT] = pos.count<KNIGHT>(c);
+      m.pieceCount[c][ROOK  ] = pos.count<ROOK  >(c);
+      m.pieceCount[c][KING  ] = 1;
+  }
 
-  // OK, we didn't find any special evaluation function for the current material
-  // configuration. Is there a suitable specialized scaling function?
-  const auto* sf = Endgames::probe<ScaleFactor>(key);
+  Entry* e = &pos.this_thread()->materialEntry;
+  int w = side_index(m.pieceCount[WHITE]), b = side_index(m.pieceCount[BLACK]);
 
-  if (sf)
+  if (w < 0 || b < 0)
   {
-      e->scalingFunction[sf->strongSide] = sf; // Only strong color assigned
+      compute(e, m, pos.material_key());
       return e;
   }
 
-  // Evaluate the material imbalance. We use PIECE_TYPE_NONE as a place holder
-  // for the bishop pair "extended piece", which allows us to be more flexible
-  // in defining bishop pair bonuses.
-  const int pieceCount[COLOR_NB][PIECE_TYPE_NB] = {
-  { pos.count<QUEEN >(WHITE) > 1, pos.count<PAWN  >(WHITE), pos.count<QUEEN>(WHITE),
-    pos.count<BISHOP>(WHITE)    , pos.count<KNIGHT>(WHITE), pos.count<ROOK >(WHITE) },
-  { pos.count<QUEEN >(BLACK) > 1, pos.count<PAWN  >(BLACK), pos.count<QUEEN>(BLACK),
-    pos.count<BISHOP>(BLACK)    , pos.count<KNIGHT>(BLACK), pos.count<ROOK >(BLACK) } };
+  // Threads computing the same entry at once store the same word
+  std::atomic<uint64_t>& slot = Table[w * SideNb + b];
+  uint64_t data = slot.load(std::memory_order_relaxed);
+
+  if (data)
+  {
+      data ^= Complement;
+      std::memcpy(e, &data, sizeof(Entry));
+  }
+  else
+  {
+      compute(e, m, pos.material_key());
+      std::memcpy(&data, e, sizeof(Entry));
+      slot.store(data ^ Complement, std::memory_order_relaxed);
+  }
 
-  e->value = int16_t((imbalance<WHITE>(pieceCount) - imbalance<BLACK>(pieceCount)) / 16);
   return e;
 }
 
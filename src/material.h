@@ -21,6 +21,8 @@
 #ifndef MATERIAL_H_INCLUDED
 #define MATERIAL_H_INCLUDED
 
+#include <vector>
+
 #include "endgame.h"
 #include "misc.h"
 #include "position.h"
@@ -28,10 +30,17 @@
 
 namespace Material {
 
+/// The specialized evaluation and scaling functions, indexed by Entry. Index 0
+/// is a null pointer, meaning that no such function applies.
+
+extern std::vector<const EndgameBase<Value>*> EvaluationFunctions;
+extern std::vector<const EndgameBase<ScaleFactor>*> ScalingFunctions;
+
 /// Material::Entry contains various information about a material configuration.
-/// It contains a material imbalance evaluation, a function pointer to a special
-/// endgame evaluation function (which in most cases is NULL, meaning that the
-/// standard evaluation function will be used), and scale factors.
+/// It contains a material imbalance evaluation, the index of a special endgame
+/// evaluation function (which in most cases is 0, meaning that the standard
+/// evaluation function will be used), and scale factors. Entries are packed in
+/// 8 bytes as there is one for every reachable material configuration.
 ///
 /// The scale factors are used to scale the evaluation score up or down. For
 /// instance, in KRB vs KR endgames, the score is scaled down by a factor of 4,
@@ -40,33 +49,34 @@ namespace Material {
 struct Entry {
 
   Score imbalance() const { return make_score(value, value); }
-  Phase game_phase() const { return gamePhase; }
-  bool specialized_eval_exists() const { return evaluationFunction != nullptr; }
-  Value evaluate(const Position& pos) const { return (*evaluationFunction)(pos); }
+  Phase game_phase() const { return Phase(gamePhase); }
+  bool specialized_eval_exists() const { return evaluationFunction != 0; }
+  Value evaluate(const Position& pos) const { return (*EvaluationFunctions[evaluationFunction])(pos); }
 
   // scale_factor takes a position and a color as input and returns a scale factor
   // for the given color. We have to provide the position in addition to the color
   // because the scale factor may also be a function which should be applied to
   // the position. For instance, in KBP vs K endgames, the scaling function looks
-  // for rook pawns and wrong-colored bishops.
+  // for rook pawns and wrong-colored bishops. Only the strong side of a scaling
+  // function uses it.
   ScaleFactor scale_factor(const Position& pos, Color c) const {
-    ScaleFactor sf = scalingFunction[c] ? (*scalingFunction[c])(pos)
-                                        :  SCALE_FACTOR_NONE;
+    const EndgameBase<ScaleFactor>* f = ScalingFunctions[scalingFunction];
+    ScaleFactor sf = f && f->strongSide == c ? (*f)(pos)
+                                             :  SCALE_FACTOR_NONE;
     return sf != SCALE_FACTOR_NONE ? sf : ScaleFactor(factor[c]);
   }
 
-  Key key;
-  const EndgameBase<Value>* evaluationFunction;
-  const EndgameBase<ScaleFactor>* scalingFunction[COLOR_NB]; // Could be one for each
-                                                             // side (e.g. KPKP, KBPsK)
   int16_t value;
+  uint16_t evaluationFunction;
+  uint8_t scalingFunction;
   uint8_t factor[COLOR_NB];
-  Phase gamePhase;
+  uint8_t gamePhase;
 };
 
-typedef HashTable<Entry, 8192> Table;
+static_assert(sizeof(Entry) == 8, "Unexpected Material::Entry size");
 
-Entry* probe(const Position& pos);
+void init();
+const Entry* probe(const Position& pos);
 
 } // namespace Material
 
@@ -29,6 +29,8 @@
 #endif
 
 #include <windows.h>
+#include <malloc.h> // For _mm_malloc()
+
 // The needed Windows API for processor groups could be missed from old Windows
 // versions, so instead of calling them directly (forcing the linker to resolve
 // the calls at compile time), try to load them at runtime. To do this we need
@@ -41,14 +43,32 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 }
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <mutex>
 #include <sstream>
 #include <vector>
 
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "misc.h"
 #include "thread.h"
+#include "uci.h"
 
 using namespace std;
 
@@ -94,10 +114,16 @@ class Logger {
   ofstream file;
   Tie in, out;
 
+  static Logger& instance() {
+
+    static Logger l;
+    return l;
+  }
+
 public:
   static void start(const std::string& fname) {
 
-    static Logger l;
+    Logger& l = instance();
 
     if (!fname.empty() && !l.file.is_open())
     {
@@ -112,6 +138,15 @@ public:
         l.file.close();
     }
   }
+
+  // Engine internal notes go to the log file only, marked with "## "
+  static void write(const std::string& msg) {
+
+    Logger& l = instance();
+
+    if (l.file.is_open())
+        l.file << "## " << msg << endl;
+  }
 };
 
 } // namespace
@@ -137,6 +172,19 @@ const string engine_info(bool to_uci) {
 
   ss << (Is64Bit ? "64" : "")
      << (HasPext ? "BMI2" : (HasPopCnt ? "POPCNT" : ""))
+#if defined(USE_DISPATCH)
+#  if defined(USE_VNNI)
+     << " VNNI (dispatched)"
+#  elif defined(USE_AVX512)
+     << " AVX512 (dispatched)"
+#  elif defined(USE_AVX2)
+     << " AVX2 (dispatched)"
+#  elif defined(USE_SSE41)
+     << " SSE41 (dispatched)"
+#  else
+     << " SSE2 (dispatched)"
+#  endif
+#endif
      << (to_uci  ? "\nid author ": " by ")
      << "Nongbossmakrukthai, T.Phoomechai Saihom, GRmakruk22 & pr0rp Redghost & Stockfish Developers (See Author File)";
 
@@ -180,8 +228,9 @@ std::ostream& operator<<(std::ostream& os, SyncCout sc) {
 }
 
 
-/// Trampoline helper to avoid moving Logger to misc.h
+/// Trampoline helpers to avoid moving Logger to misc.h
 void start_logger(const std::string& fname) { Logger::start(fname); }
+void dbg_log(const std::string& msg) { Logger::write(msg); }
 
 
 /// prefetch() preloads the given address in L1/L2 cache. This is a non-blocking
@@ -210,11 +259,368 @@ void prefetch(void* addr) {
 
 #endif
 
+
+/// std_aligned_alloc() is our wrapper for systems where the C++17 implementation
+/// does not guarantee the availability of aligned_alloc(). Memory allocated with
+/// std_aligned_alloc() must be freed with std_aligned_free().
+
+void* std_aligned_alloc(size_t alignment, size_t size) {
+
+#if defined(_WIN32)
+  return _mm_malloc(size, alignment);
+#else
+  void* mem;
+  return posix_memalign(&mem, alignment, size) ? nullptr : mem;
+#endif
+}
+
+void std_aligned_free(void* ptr) {
+
+#if defined(_WIN32)
+  _mm_free(ptr);
+#else
+  free(ptr);
+#endif
+}
+
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+namespace {
+
+  constexpr size_t HugePageSize = 2 * 1024 * 1024; // assumed x86-64 huge page size
+
+  // Mappings obtained with MAP_HUGETLB must be released with munmap(), which
+  // needs their size, so we keep track of them here.
+  std::mutex hugeTlbMutex;
+  std::map<void*, size_t> hugeTlbMappings;
+
+  // madvise(MADV_HUGEPAGE) succeeds even when transparent huge pages are
+  // disabled system wide, so check the kernel setting before claiming them.
+  bool transparent_huge_pages_enabled() {
+
+    std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string mode;
+    return std::getline(file, mode) && mode.find("[never]") == std::string::npos;
+  }
+
+  // Tell the GUI which kind of pages backs our big tables. The message is
+  // only repeated when the kind of pages changes. Tables may be allocated by
+  // several threads at once, hence the atomic.
+  void report_pages(const char* kind) {
+
+    static std::atomic<const char*> lastKind(nullptr);
+
+    if (lastKind.exchange(kind) != kind)
+        sync_cout << "info string Large page allocation: " << kind << " used" << sync_endl;
+  }
+
+} // namespace
+
+#endif
+
+
+/// aligned_large_pages_alloc() returns memory aligned on a page boundary, to be
+/// freed with aligned_large_pages_free(). On Linux it first tries explicit 2MB
+/// pages reserved by the administrator (MAP_HUGETLB), then falls back to 2MB
+/// aligned memory advised to be backed by transparent huge pages, and finally
+/// to plain small pages. Huge pages cut the TLB misses of TT and NNUE lookups.
+
+void* aligned_large_pages_alloc(size_t size) {
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+  // Round up to a multiple of the huge page size
+  size = ((size + HugePageSize - 1) / HugePageSize) * HugePageSize;
+
+  void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+  if (mem != MAP_FAILED)
+  {
+      std::lock_guard<std::mutex> lk(hugeTlbMutex);
+      hugeTlbMappings[mem] = size;
+      report_pages("2MB huge pages (MAP_HUGETLB)");
+      return mem;
+  }
+
+  mem = std_aligned_alloc(HugePageSize, size);
+
+  if (mem)
+      report_pages(   !madvise(mem, size, MADV_HUGEPAGE)
+                   && transparent_huge_pages_enabled() ? "transparent huge pages"
+                                                       : "small pages");
+  return mem;
+
+#else
+
+  constexpr size_t alignment = 4096; // assumed small page size
+
+  // Round up to a multiple of the alignment
+  size = ((size + alignment - 1) / alignment) * alignment;
+  return std_aligned_alloc(alignment, size);
+
+#endif
+}
+
+void aligned_large_pages_free(void* mem) {
+
+#if defined(__linux__) && !defined(__ANDROID__)
+
+  {
+      std::lock_guard<std::mutex> lk(hugeTlbMutex);
+      auto it = hugeTlbMappings.find(mem);
+
+      if (it != hugeTlbMappings.end())
+      {
+          munmap(mem, it->second);
+          hugeTlbMappings.erase(it);
+          return;
+      }
+  }
+
+#endif
+
+  std_aligned_free(mem);
+}
+
+
+/// fresh_pages_alloc() maps memory straight from the OS, whatever the state of
+/// the heap, so that none of its pages has been touched yet. On NUMA systems a
+/// page is then placed on the node of the thread touching it first. The memory
+/// must be freed with fresh_pages_free() and the same size.
+
+void* fresh_pages_alloc(size_t size) {
+
+#if defined(_WIN32)
+  return VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+  void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return mem != MAP_FAILED ? mem : nullptr;
+#endif
+}
+
+void fresh_pages_free(void* mem, size_t size) {
+
+#if defined(_WIN32)
+  (void)size;
+  VirtualFree(mem, 0, MEM_RELEASE);
+#else
+  if (mem)
+      munmap(mem, size);
+#endif
+}
+
+
+/// map_file() maps a whole file read-only into memory. The mapping is shared,
+/// so processes mapping the same file use the same physical pages, and nothing
+/// is read before it is touched. It returns nullptr on failure, otherwise the
+/// size and the mapping handle needed by unmap_file().
+
+const void* map_file(const std::string& fname, size_t& size, uint64_t& mapping) {
+
+#if defined(_WIN32)
+
+  HANDLE fd = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                          OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (fd == INVALID_HANDLE_VALUE)
+      return nullptr;
+
+  LARGE_INTEGER fileSize;
+  HANDLE mmap = nullptr;
+
+  if (GetFileSizeEx(fd, &fileSize) && fileSize.QuadPart)
+      mmap = CreateFileMapping(fd, nullptr, PAGE_READONLY, 0, 0, nullptr);
+
+  CloseHandle(fd);
+
+  if (!mmap)
+      return nullptr;
+
+  const void* addr = MapViewOfFile(mmap, FILE_MAP_READ, 0, 0, 0);
+  if (!addr)
+  {
+      CloseHandle(mmap);
+      return nullptr;
+  }
+
+  size = size_t(fileSize.QuadPart);
+  mapping = uint64_t(mmap);
+  return addr;
+
+#else
+
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd == -1)
+      return nullptr;
+
+  struct stat statbuf;
+  void* addr = MAP_FAILED;
+
+  if (!fstat(fd, &statbuf) && statbuf.st_size)
+      addr = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+  ::close(fd);
+
+  if (addr == MAP_FAILED)
+      return nullptr;
+
+  size = size_t(statbuf.st_size);
+  mapping = 0;
+  return addr;
+
+#endif
+}
+
+void unmap_file(const void* addr, size_t size, uint64_t mapping) {
+
+  if (!addr)
+      return;
+
+#if defined(_WIN32)
+  (void)size;
+  UnmapViewOfFile(addr);
+  CloseHandle((HANDLE)mapping);
+#else
+  (void)mapping;
+  munmap(const_cast<void*>(addr), size);
+#endif
+}
+
+
 namespace WinProcGroup {
 
-#ifndef _WIN32
+#if defined(__linux__) && !defined(__ANDROID__)
+
+/// On Linux the topology is read from sysfs: NUMA nodes from
+/// /sys/devices/system/node and physical cores from the SMT sibling lists in
+/// /sys/devices/system/cpu. Each search thread is then pinned to one logical
+/// CPU, using physical cores before their SMT siblings. The "Thread Binding"
+/// option chooses the order: "spread" alternates NUMA nodes, "compact" fills a
+/// node before moving to the next one, and "none" leaves it to the kernel.
+
+namespace {
+
+  // Parses a sysfs cpu list such as "0-3,8-11"
+  std::vector<int> read_cpu_list(const std::string& path) {
+
+    std::ifstream file(path);
+    std::vector<int> cpus;
+    std::string range;
+
+    while (std::getline(file, range, ','))
+    {
+        size_t dash = range.find('-');
+        int first = std::atoi(range.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+
+        for (int c = first; c <= last; ++c)
+            cpus.push_back(c);
+    }
+
+    return cpus;
+  }
+
+  struct Cpu {
+    int id, node, smtRank, rankInNode;
+  };
+
+  // Returns the CPUs this process may run on, in "compact" and "spread" order
+  std::pair<std::vector<int>, std::vector<int>> binding_orders() {
+
+    const std::string sysCpu = "/sys/devices/system/cpu/", sysNode = "/sys/devices/system/node/";
+    std::vector<Cpu> cpus;
+    cpu_set_t allowed;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed))
+        return {};
+
+    for (int id : read_cpu_list(sysCpu + "online"))
+        if (CPU_ISSET(id, &allowed))
+        {
+            // The position in the sibling list tells physical cores (0) apart
+            // from their additional hardware threads
+            std::vector<int> siblings = read_cpu_list(sysCpu + "cpu" + std::to_string(id)
+                                                      + "/topology/thread_siblings_list");
+            auto it = std::find(siblings.begin(), siblings.end(), id);
+            cpus.push_back({ id, 0, it != siblings.end() ? int(it - siblings.begin()) : 0, 0 });
+        }
+
+    // Kernels without NUMA support have no node directory, all CPUs are on node 0
+    for (int n : read_cpu_list(sysNode + "online"))
+        for (int id : read_cpu_list(sysNode + "node" + std::to_string(n) + "/cpulist"))
+            for (Cpu& c : cpus)
+                if (c.id == id)
+                    c.node = n;
+
+    // Number the CPUs of each node and SMT rank, in order of id
+    for (Cpu& c : cpus)
+        c.rankInNode = int(std::count_if(cpus.begin(), cpus.end(), [&](const Cpu& o) {
+                               return o.node == c.node && o.smtRank == c.smtRank && o.id < c.id; }));
+
+    std::vector<Cpu> compact = cpus, spread = cpus;
+
+    std::stable_sort(compact.begin(), compact.end(), [](const Cpu& a, const Cpu& b) {
+        return a.node != b.node ? a.node < b.node : a.smtRank < b.smtRank; });
+
+    std::stable_sort(spread.begin(), spread.end(), [](const Cpu& a, const Cpu& b) {
+        return a.smtRank    != b.smtRank    ? a.smtRank    < b.smtRank
+             : a.rankInNode != b.rankInNode ? a.rankInNode < b.rankInNode
+                                            : a.node       < b.node; });
+
+    std::pair<std::vector<int>, std::vector<int>> orders;
+
+    for (const Cpu& c : compact)
+        orders.first.push_back(c.id);
+
+    for (const Cpu& c : spread)
+        orders.second.push_back(c.id);
+
+    return orders;
+  }
+
+} // namespace
+
+
+/// bindThisThread() pins the current thread to the logical CPU chosen for
+/// thread idx. Threads beyond the number of available CPUs are left unbound.
+
+void bindThisThread(size_t idx) {
+
+  const std::string policy = Options["Thread Binding"];
+
+  if (policy == "none")
+      return;
+
+  // The topology doesn't change at runtime, read it once (thread-safe)
+  static const auto orders = binding_orders();
+
+  const std::vector<int>& order = policy == "compact" ? orders.first : orders.second;
+
+  if (idx >= order.size())
+      return;
+
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(order[idx], &cpus);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+
+/// unbindThisThread() gives the current thread back the CPUs of the process,
+/// read from its main thread, which is never bound.
+
+void unbindThisThread() {
+
+  cpu_set_t cpus;
+  if (!sched_getaffinity(getpid(), sizeof(cpus), &cpus))
+      pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+}
+
+#elif !defined(_WIN32)
 
 void bindThisThread(size_t) {}
+void unbindThisThread() {}
 
 #else
 
@@ -312,6 +718,17 @@ void bindThisThread(size_t idx) {
       fun3(GetCurrentThread(), &affinity, nullptr);
 }
 
+
+/// unbindThisThread() gives the current thread back the processors of the
+/// process, in its primary group.
+
+void unbindThisThread() {
+
+  DWORD_PTR processMask, systemMask;
+  if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask))
+      SetThreadAffinityMask(GetCurrentThread(), processMask);
+}
+
 #endif
 
 } // namespace WinProcGroup
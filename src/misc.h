@@ -21,8 +21,10 @@
 #ifndef MISC_H_INCLUDED
 #define MISC_H_INCLUDED
 
+#include <algorithm>
 #include <cassert>
 #include <chrono>
+#include <cstddef>
 #include <ostream>
 #include <string>
 #include <vector>
@@ -32,6 +34,15 @@
 const std::string engine_info(bool to_uci = false);
 void prefetch(void* addr);
 void start_logger(const std::string& fname);
+void dbg_log(const std::string& msg); // Written only if the debug log file is open
+void* std_aligned_alloc(size_t alignment, size_t size);
+void std_aligned_free(void* ptr);
+void* aligned_large_pages_alloc(size_t size); // memory aligned by page size, min alignment: 4096 bytes
+void aligned_large_pages_free(void* mem);     // nop if mem == nullptr
+void* fresh_pages_alloc(size_t size);          // pages never touched before, nullptr on failure
+void fresh_pages_free(void* mem, size_t size);
+const void* map_file(const std::string& fname, size_t& size, uint64_t& mapping); // read-only, shared
+void unmap_file(const void* addr, size_t size, uint64_t mapping);
 
 void dbg_hit_on(bool b);
 void dbg_hit_on(bool c, bool b);
@@ -56,6 +67,68 @@ private:
 };
 
 
+/// align_ptr_up() returns the first address at or after ptr which is a multiple
+/// of Alignment. Used for stack buffers when alignas() can't be trusted.
+
+template<uintptr_t Alignment, typename T>
+T* align_ptr_up(T* ptr) {
+
+  static_assert(alignof(T) < Alignment, "Pointer type is already more aligned than requested");
+
+  const uintptr_t ptrint = reinterpret_cast<uintptr_t>(reinterpret_cast<char*>(ptr));
+  return reinterpret_cast<T*>(reinterpret_cast<char*>((ptrint + (Alignment - 1)) / Alignment * Alignment));
+}
+
+
+/// ValueList is a fixed capacity vector living on the stack, and
+/// ValueListInserter a light handle that lets a callee append to it without
+/// knowing its capacity. Both are used by the NNUE feature sets.
+
+template<typename T> class ValueListInserter;
+
+template<typename T, size_t MaxSize>
+class ValueList {
+
+public:
+  size_t size() const { return size_; }
+  void resize(size_t newSize) { size_ = newSize; }
+  void push_back(const T& value) { values_[size_++] = value; }
+  T& operator[](size_t index) { return values_[index]; }
+  T* begin() { return values_; }
+  T* end() { return values_ + size_; }
+  const T& operator[](size_t index) const { return values_[index]; }
+  const T* begin() const { return values_; }
+  const T* end() const { return values_ + size_; }
+
+  void swap(ValueList& other) {
+    const size_t maxSize = std::max(size_, other.size_);
+    for (size_t i = 0; i < maxSize; ++i)
+        std::swap(values_[i], other.values_[i]);
+    std::swap(size_, other.size_);
+  }
+
+private:
+  friend class ValueListInserter<T>;
+
+  T values_[MaxSize];
+  size_t size_ = 0;
+};
+
+template<typename T>
+class ValueListInserter {
+
+public:
+  template<size_t MaxSize>
+  ValueListInserter(ValueList<T, MaxSize>& list) : values(list.values_), size(&list.size_) {}
+
+  void push_back(const T& value) { values[(*size)++] = value; }
+
+private:
+  T* values;
+  size_t* size;
+};
+
+
 enum SyncCout { IO_LOCK, IO_UNLOCK };
 std::ostream& operator<<(std::ostream&, SyncCout);
 
@@ -104,10 +177,12 @@ public:
 /// logical processor group. This usually means to be limited to use max 64
 /// cores. To overcome this, some special platform specific API should be
 /// called to set group affinity for each thread. Original code from Texel by
-/// Peter Österlund.
+/// Peter Österlund. On Linux the same entry point pins threads to CPUs spread
+/// over NUMA nodes and physical cores, see the "Thread Binding" option.
 
 namespace WinProcGroup {
   void bindThisThread(size_t idx);
+  void unbindThisThread();
 }
 
 #endif // #ifndef MISC_H_INCLUDED
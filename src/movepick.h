@@ -81,6 +81,27 @@ struct Stats<T, D, Size> : public std::array<StatsEntry<T, D>, Size> {};
 /// In stats table, D=0 means that the template parameter is not used
 enum StatsParams { NOT_USED = 0 };
 
+/// Makruk has 6 piece types for each color, so tables indexed by piece store
+/// only NO_PIECE and the 12 real pieces, at index piece_index(pc) instead of pc.
+constexpr int PIECE_INDEX_NB = 13;
+
+constexpr int piece_index(Piece pc) {
+  return pc - 2 * (pc >> 3); // W_PAWN..W_KING -> 1..6, B_PAWN..B_KING -> 7..12
+}
+
+static_assert(piece_index(B_KING) == PIECE_INDEX_NB - 1, "Wrong PIECE_INDEX_NB");
+
+/// PieceStats is a Stats whose first dimension is indexed by a Piece, stored
+/// compacted with piece_index().
+template <typename T, int D, int... Sizes>
+struct PieceStats : public Stats<T, D, PIECE_INDEX_NB, Sizes...>
+{
+  typedef Stats<T, D, PIECE_INDEX_NB, Sizes...> stats;
+
+  auto& operator[](Piece pc) { return stats::operator[](piece_index(pc)); }
+  const auto& operator[](Piece pc) const { return stats::operator[](piece_index(pc)); }
+};
+
 
 /// ButterflyHistory records how often quiet moves have been successful or
 /// unsuccessful during the current search, and is used for reduction and move
@@ -90,18 +111,18 @@ typedef Stats<int16_t, 10692, COLOR_NB, int(SQUARE_NB) * int(SQUARE_NB)> Butterf
 
 /// CounterMoveHistory stores counter moves indexed by [piece][to] of the previous
 /// move, see www.chessprogramming.org/Countermove_Heuristic
-typedef Stats<Move, NOT_USED, PIECE_NB, SQUARE_NB> CounterMoveHistory;
+typedef PieceStats<Move, NOT_USED, SQUARE_NB> CounterMoveHistory;
 
 /// CapturePieceToHistory is addressed by a move's [piece][to][captured piece type]
-typedef Stats<int16_t, 10692, PIECE_NB, SQUARE_NB, PIECE_TYPE_NB> CapturePieceToHistory;
+typedef PieceStats<int16_t, 10692, SQUARE_NB, PIECE_TYPE_NB> CapturePieceToHistory;
 
 /// PieceToHistory is like ButterflyHistory but is addressed by a move's [piece][to]
-typedef Stats<int16_t, 29952, PIECE_NB, SQUARE_NB> PieceToHistory;
+typedef PieceStats<int16_t, 29952, SQUARE_NB> PieceToHistory;
 
 /// ContinuationHistory is the combined history of a given pair of moves, usually
 /// the current one given a previous one. The nested history table is based on
 /// PieceToHistory instead of ButterflyBoards.
-typedef Stats<PieceToHistory, NOT_USED, PIECE_NB, SQUARE_NB> ContinuationHistory;
+typedef PieceStats<PieceToHistory, NOT_USED, SQUARE_NB> ContinuationHistory;
 
 
 /// MovePicker class is used to pick one pseudo legal move at a time from the
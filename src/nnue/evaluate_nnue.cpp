@@ -18,6 +18,10 @@
 
 // Code for calculating NNUE evaluation function
 
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <set>
 
@@ -29,20 +33,52 @@
 
 #include "evaluate_nnue.h"
 
-namespace Stockfish::Eval::NNUE {
+namespace Eval::NNUE {
 
-  // Input feature converter
-  LargePagePtr<FeatureTransformer> featureTransformer;
-
-  // Evaluation function
-  AlignedPtr<Network> network;
+  // Input feature converter and evaluation function. They point either to the
+  // storage below, filled from a stream, or into a mapped file.
+  const FeatureTransformer* featureTransformer;
+  const Network* network;
 
   // Evaluation function file name
   std::string fileName;
   std::string netDescription;
 
+  // Memory layout of the parameters, which depends on the build: the SSSE3 and
+  // later kernels permute the affine weights and, without VNNI, move those that
+  // could saturate 16 bits to a side list. A mapped file must have the same.
+#if defined(USE_VNNI)
+  constexpr char Layout[8] = "vnni";
+#elif defined(USE_SSSE3)
+  constexpr char Layout[8] = "ssse3";
+#else
+  constexpr char Layout[8] = "plain";
+#endif
+
+  // Header of a mapped network file. The description follows it, then the
+  // parameters exactly as they lie in memory, at page aligned offsets.
+  struct MappedHeader {
+    char magic[8];
+    char layout[8];
+    std::uint32_t hashValue;
+    std::uint32_t descSize;
+    std::uint64_t transformerOffset, transformerSize;
+    std::uint64_t networkOffset, networkSize;
+  };
+
+  constexpr char MappedMagic[8] = "NNUEMAP";
+  constexpr std::uint64_t MappedAlignment = 4096;
+
   namespace Detail {
 
+  LargePagePtr<FeatureTransformer> transformerStorage;
+  AlignedPtr<Network> networkStorage;
+
+  // The mapped file, if any
+  const void* mappedAddress;
+  std::size_t mappedSize;
+  std::uint64_t mapping;
+
   // Initialize the evaluation function parameters
   template <typename T>
   void initialize(AlignedPtr<T>& pointer) {
@@ -79,11 +115,21 @@ namespace Stockfish::Eval::NNUE {
 
   }  // namespace Detail
 
+  // Release a mapped file
+  void unmap() {
+
+    unmap_file(Detail::mappedAddress, Detail::mappedSize, Detail::mapping);
+    Detail::mappedAddress = nullptr;
+  }
+
   // Initialize the evaluation function parameters
   void initialize() {
 
-    Detail::initialize(featureTransformer);
-    Detail::initialize(network);
+    unmap();
+    Detail::initialize(Detail::transformerStorage);
+    Detail::initialize(Detail::networkStorage);
+    featureTransformer = Detail::transformerStorage.get();
+    network = Detail::networkStorage.get();
   }
 
   // Read network header
@@ -116,8 +162,8 @@ namespace Stockfish::Eval::NNUE {
     std::uint32_t hashValue;
     if (!read_header(stream, &hashValue, &netDescription)) return false;
     if (hashValue != HashValue) return false;
-    if (!Detail::read_parameters(stream, *featureTransformer)) return false;
-    if (!Detail::read_parameters(stream, *network)) return false;
+    if (!Detail::read_parameters(stream, *Detail::transformerStorage)) return false;
+    if (!Detail::read_parameters(stream, *Detail::networkStorage)) return false;
     return stream && stream.peek() == std::ios::traits_type::eof();
   }
 
@@ -177,4 +223,160 @@ namespace Stockfish::Eval::NNUE {
     return write_parameters(stream);
   }
 
-} // namespace Stockfish::Eval::NNUE
+  // Map eval from a file written by save_mapped_eval(). Returns false, keeping
+  // the current network, if the file is not in this format or has another
+  // layout, so that the caller can read it as a stream instead.
+  bool map_eval(std::string name) {
+
+    MappedHeader header;
+    std::ifstream file(name, std::ios::binary);
+
+    if (   !file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.magic, MappedMagic, sizeof(MappedMagic))
+        || std::memcmp(header.layout, Layout, sizeof(Layout))
+        || header.hashValue != HashValue
+        || header.transformerSize != sizeof(FeatureTransformer)
+        || header.networkSize != sizeof(Network)
+        || header.transformerOffset % MappedAlignment
+        || header.networkOffset % MappedAlignment
+        || sizeof(header) + header.descSize > header.transformerOffset)
+        return false;
+
+    file.close();
+
+    std::size_t size;
+    std::uint64_t mapping;
+    const char* addr = static_cast<const char*>(map_file(name, size, mapping));
+
+    if (   !addr
+        || size < header.transformerOffset + header.transformerSize
+        || size < header.networkOffset + header.networkSize)
+    {
+        unmap_file(addr, size, mapping);
+        return false;
+    }
+
+    unmap();
+    Detail::transformerStorage.reset();
+    Detail::networkStorage.reset();
+
+    Detail::mappedAddress = addr;
+    Detail::mappedSize = size;
+    Detail::mapping = mapping;
+
+    featureTransformer = reinterpret_cast<const FeatureTransformer*>(addr + header.transformerOffset);
+    network = reinterpret_cast<const Network*>(addr + header.networkOffset);
+    fileName = name;
+    netDescription.assign(addr + sizeof(header), header.descSize);
+    return true;
+  }
+
+  // Save eval in the mapped format, with the layout of this build
+  bool save_mapped_eval(std::ostream& stream) {
+
+    if (fileName.empty())
+      return false;
+
+    auto page_align = [](std::uint64_t offset) {
+      return (offset + MappedAlignment - 1) / MappedAlignment * MappedAlignment;
+    };
+
+    MappedHeader header = {};
+    std::memcpy(header.magic, MappedMagic, sizeof(MappedMagic));
+    std::memcpy(header.layout, Layout, sizeof(Layout));
+    header.hashValue = HashValue;
+    header.descSize = std::uint32_t(netDescription.size());
+    header.transformerOffset = page_align(sizeof(header) + header.descSize);
+    header.transformerSize = sizeof(FeatureTransformer);
+    header.networkOffset = page_align(header.transformerOffset + header.transformerSize);
+    header.networkSize = sizeof(Network);
+
+    auto pad_to = [&](std::uint64_t offset) {
+      while (std::uint64_t(stream.tellp()) < offset)
+          stream.put(0);
+    };
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(netDescription.data(), netDescription.size());
+    pad_to(header.transformerOffset);
+    stream.write(reinterpret_cast<const char*>(featureTransformer), sizeof(FeatureTransformer));
+    pad_to(header.networkOffset);
+    stream.write(reinterpret_cast<const char*>(network), sizeof(Network));
+    return (bool)stream;
+  }
+
+  // Time the dense and the sparse kernel of the first hidden layer on the
+  // transformed features of the given positions, for "microbench nnue"
+  void time_first_layer(const std::vector<std::string>& fens, uint64_t iterations) {
+
+    const auto& firstLayer =
+        network->previous_layer().previous_layer().previous_layer().previous_layer();
+
+    using FirstLayer = std::remove_reference_t<decltype(firstLayer)>;
+    using Output = FirstLayer::OutputType;
+
+    constexpr std::size_t InputSize = FeatureTransformer::BufferSize;
+    constexpr std::size_t BufferSize = ceil_to_multiple(FirstLayer::BufferSize, CacheLineSize);
+
+    const std::size_t count = fens.size();
+    auto block = static_cast<char*>(std_aligned_alloc(CacheLineSize, count * InputSize + 2 * BufferSize));
+    auto inputs = reinterpret_cast<TransformedFeatureType*>(block);
+    char* dense = block + count * InputSize;
+    char* sparse = dense + BufferSize;
+
+    // Both kernels must give the same output
+    bool identical = true;
+    std::size_t nonZero = 0;
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        StateInfo st;
+        Position pos;
+        pos.set(fens[i], false, &st, nullptr);
+
+        TransformedFeatureType* input = inputs + i * InputSize;
+        featureTransformer->transform(pos, input);
+
+        for (std::size_t k = 0; k < FirstLayer::InputDimensions; k += 4)
+            nonZero += input[k] || input[k + 1] || input[k + 2] || input[k + 3];
+
+        identical &= !std::memcmp(firstLayer.template propagate<false>(input, dense),
+                                  firstLayer.template propagate<true>(input, sparse),
+                                  FirstLayer::OutputDimensions * sizeof(Output));
+    }
+
+    auto time = [&](auto propagate) {
+
+      auto start = std::chrono::steady_clock::now();
+      Output sum = 0;
+
+      for (uint64_t n = 0, i = 0; n < iterations; ++n, i = (i + 1 < count ? i + 1 : 0))
+          sum += propagate(inputs + i * InputSize)[0];
+
+      // Keep the compiler from moving the loop past the end of the timing
+      volatile Output sink = sum;
+      (void)sink;
+
+      std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+      return elapsed.count() / iterations;
+    };
+
+    double denseTime = time([&](const TransformedFeatureType* input) {
+        return firstLayer.template propagate<false>(input, dense);
+    });
+
+    double sparseTime = time([&](const TransformedFeatureType* input) {
+        return firstLayer.template propagate<true>(input, sparse);
+    });
+
+    std_aligned_free(block);
+
+    std::cerr << "\nNNUE first layer: " << count << " positions, " << iterations
+              << " propagations, " << std::fixed << std::setprecision(2)
+              << 100.0 * nonZero / (count * FirstLayer::InputDimensions / 4)
+              << "% nonzero input chunks, outputs " << (identical ? "identical" : "DIFFERENT")
+              << "\ndense kernel (ns/propagation)  : " << denseTime
+              << "\nsparse kernel (ns/propagation) : " << sparseTime << std::endl;
+  }
+
+} // namespace Eval::NNUE
@@ -22,7 +22,7 @@
 
 #include "../../position.h"
 
-namespace Stockfish::Eval::NNUE::Features {
+namespace Eval::NNUE::Features {
 
   // Orient a square according to perspective (rotates by 180 for black)
   inline Square HalfKP::orient(Color perspective, Square s) {
@@ -44,7 +44,7 @@ namespace Stockfish::Eval::NNUE::Features {
     Bitboard bb = pos.pieces() & ~pos.pieces(KING);
     while (bb)
     {
-      Square s = pop_lsb(bb);
+      Square s = pop_lsb(&bb);
       active.push_back(make_index(perspective, s, pos.piece_on(s), ksq));
     }
   }
@@ -83,4 +83,4 @@ namespace Stockfish::Eval::NNUE::Features {
     return st->dirtyPiece.piece[0] == make_piece(perspective, KING);
   }
 
-}  // namespace Stockfish::Eval::NNUE::Features
+}  // namespace Eval::NNUE::Features
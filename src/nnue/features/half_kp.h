@@ -26,42 +26,42 @@
 #include "../../evaluate.h"
 #include "../../misc.h"
 
-namespace Stockfish {
-  struct StateInfo;
-}
+struct StateInfo;
 
-namespace Stockfish::Eval::NNUE::Features {
+namespace Eval::NNUE::Features {
 
   // Feature HalfKP: Combination of the position of own king
   // and the position of pieces other than kings
   class HalfKP {
 
-    // unique number for each piece type on each square
+    // unique number for each piece type on each square, in the order of the
+    // Makruk PieceType enum: Bia (pawn), Met (queen), Khon (bishop), Ma, Rua
     enum {
       PS_NONE     =  0,
       PS_W_PAWN   =  1,
       PS_B_PAWN   =  1 * SQUARE_NB + 1,
-      PS_W_KNIGHT =  2 * SQUARE_NB + 1,
-      PS_B_KNIGHT =  3 * SQUARE_NB + 1,
+      PS_W_QUEEN  =  2 * SQUARE_NB + 1,
+      PS_B_QUEEN  =  3 * SQUARE_NB + 1,
       PS_W_BISHOP =  4 * SQUARE_NB + 1,
       PS_B_BISHOP =  5 * SQUARE_NB + 1,
-      PS_W_ROOK   =  6 * SQUARE_NB + 1,
-      PS_B_ROOK   =  7 * SQUARE_NB + 1,
-      PS_W_QUEEN  =  8 * SQUARE_NB + 1,
-      PS_B_QUEEN  =  9 * SQUARE_NB + 1,
+      PS_W_KNIGHT =  6 * SQUARE_NB + 1,
+      PS_B_KNIGHT =  7 * SQUARE_NB + 1,
+      PS_W_ROOK   =  8 * SQUARE_NB + 1,
+      PS_B_ROOK   =  9 * SQUARE_NB + 1,
       PS_NB = 10 * SQUARE_NB + 1
     };
 
     static constexpr IndexType PieceSquareIndex[COLOR_NB][PIECE_NB] = {
       // convention: W - us, B - them
       // viewed from other side, W and B are reversed
-      { PS_NONE, PS_W_PAWN, PS_W_KNIGHT, PS_W_BISHOP, PS_W_ROOK, PS_W_QUEEN, PS_NONE, PS_NONE,
-        PS_NONE, PS_B_PAWN, PS_B_KNIGHT, PS_B_BISHOP, PS_B_ROOK, PS_B_QUEEN, PS_NONE, PS_NONE },
-      { PS_NONE, PS_B_PAWN, PS_B_KNIGHT, PS_B_BISHOP, PS_B_ROOK, PS_B_QUEEN, PS_NONE, PS_NONE,
-        PS_NONE, PS_W_PAWN, PS_W_KNIGHT, PS_W_BISHOP, PS_W_ROOK, PS_W_QUEEN, PS_NONE, PS_NONE }
+      { PS_NONE, PS_W_PAWN, PS_W_QUEEN, PS_W_BISHOP, PS_W_KNIGHT, PS_W_ROOK, PS_NONE, PS_NONE,
+        PS_NONE, PS_B_PAWN, PS_B_QUEEN, PS_B_BISHOP, PS_B_KNIGHT, PS_B_ROOK, PS_NONE, PS_NONE },
+      { PS_NONE, PS_B_PAWN, PS_B_QUEEN, PS_B_BISHOP, PS_B_KNIGHT, PS_B_ROOK, PS_NONE, PS_NONE,
+        PS_NONE, PS_W_PAWN, PS_W_QUEEN, PS_W_BISHOP, PS_W_KNIGHT, PS_W_ROOK, PS_NONE, PS_NONE }
     };
 
-    // Orient a square according to perspective (rotates by 180 for black)
+    // Orient a square according to perspective (rotates by 180 for black, which
+    // also maps the Makruk kings' d1/e8 start squares onto each other)
     static Square orient(Color perspective, Square s);
 
     // Index of a feature for a given king position and another piece on some square
@@ -78,7 +78,7 @@ namespace Stockfish::Eval::NNUE::Features {
     static constexpr IndexType Dimensions =
         static_cast<IndexType>(SQUARE_NB) * static_cast<IndexType>(PS_NB);
 
-    // Maximum number of simultaneously active features. 30 because kins are not included.
+    // Maximum number of simultaneously active features. 30 because kings are not included.
     static constexpr IndexType MaxActiveDimensions = 30;
 
     // Get a list of indices for active features
@@ -105,6 +105,6 @@ namespace Stockfish::Eval::NNUE::Features {
     static bool requires_refresh(StateInfo* st, Color perspective);
   };
 
-}  // namespace Stockfish::Eval::NNUE::Features
+}  // namespace Eval::NNUE::Features
 
 #endif // #ifndef NNUE_FEATURES_HALF_KP_H_INCLUDED
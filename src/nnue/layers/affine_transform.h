@@ -21,10 +21,24 @@
 #ifndef NNUE_LAYERS_AFFINE_TRANSFORM_H_INCLUDED
 #define NNUE_LAYERS_AFFINE_TRANSFORM_H_INCLUDED
 
+#include <array>
 #include <iostream>
 #include "../nnue_common.h"
+#include "../../bitboard.h"
 
-namespace Stockfish::Eval::NNUE::Layers {
+namespace Eval::NNUE::Layers {
+
+#if defined (USE_SSSE3)
+  // Positions of the set bits of each byte, in the first entries
+  alignas(16) inline const auto BitIndices = [] {
+    std::array<std::uint16_t[8], 256> indices{};
+    for (unsigned m = 0; m < 256; ++m)
+        for (unsigned b = 0, k = 0; b < 8; ++b)
+            if (m & (1 << b))
+                indices[m][k++] = b;
+    return indices;
+  }();
+#endif
 
   // Affine transformation layer
   template <typename PreviousLayer, IndexType OutDims>
@@ -47,6 +61,16 @@ namespace Stockfish::Eval::NNUE::Layers {
     static constexpr const IndexType OutputSimdWidth = SimdWidth / 4;
 #endif
 
+    // The input of the first layer is the clipped output of the feature
+    // transformer, which is mostly zeros. There propagate() looks for the
+    // nonzero 4-byte chunks of the input and only adds their columns.
+#if defined (USE_SSSE3)
+    static constexpr bool SparseInput =
+        InputDimensions >= 256 && OutputDimensions % OutputSimdWidth == 0;
+#else
+    static constexpr bool SparseInput = false;
+#endif
+
     // Size of forward propagation buffer used in this layer
     static constexpr std::size_t SelfBufferSize =
         ceil_to_multiple(OutputDimensions * sizeof(OutputType), CacheLineSize);
@@ -158,7 +182,9 @@ namespace Stockfish::Eval::NNUE::Layers {
       return !stream.fail();
     }
 
-    // Forward propagation
+    // Forward propagation. Sparse selects the kernel of layers with a multiple
+    // of OutputSimdWidth outputs, the microbench times both on the same input.
+    template <bool Sparse = SparseInput>
     const OutputType* propagate(
         const TransformedFeatureType* transformedFeatures, char* buffer) const {
       const auto input = previousLayer.propagate(
@@ -214,6 +240,13 @@ namespace Stockfish::Eval::NNUE::Layers {
         return _mm_cvtsi128_si32(sum128) + bias;
       };
 
+      // Mask of the nonzero 4-byte chunks of 32 input bytes. The chunks are
+      // never negative, as their bytes are at most 127.
+      [[maybe_unused]] auto m256_nnz8 = [](const void* p) -> unsigned {
+        const __m256i a = _mm256_load_si256(static_cast<const __m256i*>(p));
+        return _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(a, _mm256_setzero_si256())));
+      };
+
       [[maybe_unused]] auto m256_add_dpbusd_epi32 = [=](__m256i& acc, __m256i a, __m256i b) {
 #if defined (USE_VNNI)
         acc = _mm256_dpbusd_epi32(acc, a, b);
@@ -255,6 +288,13 @@ namespace Stockfish::Eval::NNUE::Layers {
         return _mm_cvtsi128_si32(sum) + bias;
       };
 
+      [[maybe_unused]] auto m128_nnz8 = [](const void* p) -> unsigned {
+        const __m128i a0 = _mm_load_si128(static_cast<const __m128i*>(p));
+        const __m128i a1 = _mm_load_si128(static_cast<const __m128i*>(p) + 1);
+        return   _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(a0, _mm_setzero_si128())))
+              | (_mm_movemask_ps(_mm_castsi128_ps(_mm_cmpgt_epi32(a1, _mm_setzero_si128()))) << 4);
+      };
+
       [[maybe_unused]] auto m128_add_dpbusd_epi32 = [=](__m128i& acc, __m128i a, __m128i b) {
         __m128i product0 = _mm_maddubs_epi16(a, b);
         product0 = _mm_madd_epi16(product0, Ones128);
@@ -280,6 +320,7 @@ namespace Stockfish::Eval::NNUE::Layers {
       using vec_t = __m512i;
       #define vec_setzero _mm512_setzero_si512
       #define vec_set_32 _mm512_set1_epi32
+      auto& vec_nnz8 = m256_nnz8;
       auto& vec_add_dpbusd_32 = m512_add_dpbusd_epi32;
       auto& vec_add_dpbusd_32x4 = m512_add_dpbusd_epi32x4;
       auto& vec_hadd = m512_hadd;
@@ -287,6 +328,7 @@ namespace Stockfish::Eval::NNUE::Layers {
       using vec_t = __m256i;
       #define vec_setzero _mm256_setzero_si256
       #define vec_set_32 _mm256_set1_epi32
+      auto& vec_nnz8 = m256_nnz8;
       auto& vec_add_dpbusd_32 = m256_add_dpbusd_epi32;
       auto& vec_add_dpbusd_32x4 = m256_add_dpbusd_epi32x4;
       auto& vec_hadd = m256_hadd;
@@ -294,6 +336,7 @@ namespace Stockfish::Eval::NNUE::Layers {
       using vec_t = __m128i;
       #define vec_setzero _mm_setzero_si128
       #define vec_set_32 _mm_set1_epi32
+      auto& vec_nnz8 = m128_nnz8;
       auto& vec_add_dpbusd_32 = m128_add_dpbusd_epi32;
       auto& vec_add_dpbusd_32x4 = m128_add_dpbusd_epi32x4;
       auto& vec_hadd = m128_hadd;
@@ -314,21 +357,64 @@ namespace Stockfish::Eval::NNUE::Layers {
 
           const auto input32 = reinterpret_cast<const std::int32_t*>(input);
           vec_t* outptr = reinterpret_cast<vec_t*>(output);
-          std::memcpy(output, biases, OutputDimensions * sizeof(OutputType));
 
-          for (int i = 0; i < (int)NumChunks - 3; i += 4)
+          if constexpr (Sparse)
+          {
+              static_assert(SparseInput && NumChunks % 8 == 0, "");
+
+              constexpr IndexType NumRegs = OutputDimensions / OutputSimdWidth;
+
+              // List the nonzero chunks eight at a time without branching: all
+              // the indices of a mask are stored, and only its population kept.
+              alignas(16) std::uint16_t nnz[NumChunks];
+              IndexType count = 0;
+              __m128i base = _mm_setzero_si128();
+              for (IndexType i = 0; i < NumChunks; i += 8)
+              {
+                  const unsigned mask = vec_nnz8(&input32[i]);
+                  const __m128i offsets = _mm_load_si128(reinterpret_cast<const __m128i*>(BitIndices[mask]));
+                  _mm_storeu_si128(reinterpret_cast<__m128i*>(&nnz[count]), _mm_add_epi16(base, offsets));
+                  count += popcount(mask);
+                  base = _mm_add_epi16(base, _mm_set1_epi16(8));
+              }
+
+              // A single chunk cannot saturate 16 bits, so the columns are added
+              // one by one, into registers.
+              vec_t acc[NumRegs];
+              const auto biasVector = reinterpret_cast<const vec_t*>(biases);
+              for (IndexType j = 0; j < NumRegs; ++j)
+                  acc[j] = biasVector[j];
+
+              for (IndexType k = 0; k < count; ++k)
+              {
+                  const vec_t in = vec_set_32(input32[nnz[k]]);
+                  const auto col = reinterpret_cast<const vec_t*>(&weights[nnz[k] * OutputDimensions * 4]);
+                  for (IndexType j = 0; j < NumRegs; ++j)
+                      vec_add_dpbusd_32(acc[j], in, col[j]);
+              }
+
+              for (IndexType j = 0; j < NumRegs; ++j)
+                  outptr[j] = acc[j];
+          }
+          else
           {
-              const vec_t in0 = vec_set_32(input32[i + 0]);
-              const vec_t in1 = vec_set_32(input32[i + 1]);
-              const vec_t in2 = vec_set_32(input32[i + 2]);
-              const vec_t in3 = vec_set_32(input32[i + 3]);
-              const auto col0 = reinterpret_cast<const vec_t*>(&weights[(i + 0) * OutputDimensions * 4]);
-              const auto col1 = reinterpret_cast<const vec_t*>(&weights[(i + 1) * OutputDimensions * 4]);
-              const auto col2 = reinterpret_cast<const vec_t*>(&weights[(i + 2) * OutputDimensions * 4]);
-              const auto col3 = reinterpret_cast<const vec_t*>(&weights[(i + 3) * OutputDimensions * 4]);
-              for (int j = 0; j * OutputSimdWidth < OutputDimensions; ++j)
-                  vec_add_dpbusd_32x4(outptr[j], in0, col0[j], in1, col1[j], in2, col2[j], in3, col3[j]);
+              std::memcpy(output, biases, OutputDimensions * sizeof(OutputType));
+
+              for (int i = 0; i < (int)NumChunks - 3; i += 4)
+              {
+                  const vec_t in0 = vec_set_32(input32[i + 0]);
+                  const vec_t in1 = vec_set_32(input32[i + 1]);
+                  const vec_t in2 = vec_set_32(input32[i + 2]);
+                  const vec_t in3 = vec_set_32(input32[i + 3]);
+                  const auto col0 = reinterpret_cast<const vec_t*>(&weights[(i + 0) * OutputDimensions * 4]);
+                  const auto col1 = reinterpret_cast<const vec_t*>(&weights[(i + 1) * OutputDimensions * 4]);
+                  const auto col2 = reinterpret_cast<const vec_t*>(&weights[(i + 2) * OutputDimensions * 4]);
+                  const auto col3 = reinterpret_cast<const vec_t*>(&weights[(i + 3) * OutputDimensions * 4]);
+                  for (int j = 0; j * OutputSimdWidth < OutputDimensions; ++j)
+                      vec_add_dpbusd_32x4(outptr[j], in0, col0[j], in1, col1[j], in2, col2[j], in3, col3[j]);
+              }
           }
+
           for (int i = 0; i < canSaturate16.count; ++i)
               output[canSaturate16.ids[i].out] += input[canSaturate16.ids[i].in] * canSaturate16.ids[i].w;
       }
@@ -465,6 +551,9 @@ namespace Stockfish::Eval::NNUE::Layers {
       return output;
     }
 
+    // Layer below this one, the microbench reaches the first layer through it
+    const PreviousLayer& previous_layer() const { return previousLayer; }
+
    private:
     using BiasType = OutputType;
     using WeightType = std::int8_t;
@@ -494,6 +583,6 @@ namespace Stockfish::Eval::NNUE::Layers {
 #endif
   };
 
-}  // namespace Stockfish::Eval::NNUE::Layers
+}  // namespace Eval::NNUE::Layers
 
 #endif // #ifndef NNUE_LAYERS_AFFINE_TRANSFORM_H_INCLUDED
@@ -23,7 +23,7 @@
 
 #include "../nnue_common.h"
 
-namespace Stockfish::Eval::NNUE::Layers {
+namespace Eval::NNUE::Layers {
 
   // Clipped ReLU
   template <typename PreviousLayer>
@@ -162,10 +162,13 @@ namespace Stockfish::Eval::NNUE::Layers {
       return output;
     }
 
+    // Layer below this one, the microbench reaches the first layer through it
+    const PreviousLayer& previous_layer() const { return previousLayer; }
+
    private:
     PreviousLayer previousLayer;
   };
 
-}  // namespace Stockfish::Eval::NNUE::Layers
+}  // namespace Eval::NNUE::Layers
 
 #endif // NNUE_LAYERS_CLIPPED_RELU_H_INCLUDED
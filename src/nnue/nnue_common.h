@@ -43,7 +43,7 @@
 #include <arm_neon.h>
 #endif
 
-namespace Stockfish::Eval::NNUE {
+namespace Eval::NNUE {
 
   // Version of the evaluation file
   constexpr std::uint32_t Version = 0x7AF32F16u;
@@ -117,6 +117,6 @@ namespace Stockfish::Eval::NNUE {
 
       stream.write(reinterpret_cast<char*>(u), sizeof(IntType));
   }
-}  // namespace Stockfish::Eval::NNUE
+}  // namespace Eval::NNUE
 
 #endif // #ifndef NNUE_COMMON_H_INCLUDED
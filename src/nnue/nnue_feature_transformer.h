@@ -28,7 +28,7 @@
 
 #include <cstring> // std::memset()
 
-namespace Stockfish::Eval::NNUE {
+namespace Eval::NNUE {
 
   // If vector instructions are enabled, we update and refresh the
   // accumulator tile by tile such that each tile fits in the CPU's
@@ -174,7 +174,10 @@ namespace Stockfish::Eval::NNUE {
               &reinterpret_cast<const __m512i*>(accumulation[perspectives[p]])[j * 2 + 0]);
           __m512i sum1 = _mm512_load_si512(
               &reinterpret_cast<const __m512i*>(accumulation[perspectives[p]])[j * 2 + 1]);
-          _mm512_store_si512(&out[j], _mm512_permutexvar_epi64(Control,
+          // The zero-masking form with a full mask compiles to the same vpermq,
+          // but unlike _mm512_permutexvar_epi64 it does not pass an undefined
+          // register to the builtin, which GCC reports as used uninitialized.
+          _mm512_store_si512(&out[j], _mm512_maskz_permutexvar_epi64(0xFF, Control,
               _mm512_max_epi8(_mm512_packs_epi16(sum0, sum1), Zero)));
         }
 
@@ -418,6 +421,6 @@ namespace Stockfish::Eval::NNUE {
     alignas(CacheLineSize) WeightType weights[HalfDimensions * InputDimensions];
   };
 
-}  // namespace Stockfish::Eval::NNUE
+}  // namespace Eval::NNUE
 
 #endif // #ifndef NNUE_FEATURE_TRANSFORMER_H_INCLUDED
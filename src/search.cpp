@@ -25,6 +25,7 @@
 #include <iostream>
 #include <sstream>
 
+#include "cluster.h"
 #include "evaluate.h"
 #include "misc.h"
 #include "movegen.h"
@@ -67,6 +68,11 @@ namespace {
     return Value((168 - 51 * improving) * d / ONE_PLY);
   }
 
+  // Sizes and phases of the skip-blocks, used for distributing search depths
+  // across the helper threads with the "SMP Depth Skip" option
+  constexpr int SkipSize[]  = { 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4 };
+  constexpr int SkipPhase[] = { 0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7 };
+
   // Reductions lookup table, initialized at startup
   int Reductions[MAX_MOVES]; // [depth or moveNumber]
 
@@ -144,6 +150,19 @@ namespace {
     bool otherThread, owning;
   };
 
+  // With the "SMP ABDADA" option, threads publish the moves they are searching
+  // in a small lock-free table, keyed by the position after the move. A thread
+  // finding there a move of the current node puts it off until the other moves
+  // have been searched, so that threads spread over different subtrees.
+  constexpr int AbdadaDepth = 3;
+  constexpr int MaxDeferred = 32;
+  bool UseAbdada; // Set by the main thread before the helpers start
+  std::array<std::atomic<Key>, 32768> searchingMoves;
+
+  std::atomic<Key>& searching_move(Key moveKey) {
+    return searchingMoves[moveKey & (searchingMoves.size() - 1)];
+  }
+
   template <NodeType NT>
   Value search(Position& pos, Stack* ss, Value alpha, Value beta, Depth depth, bool cutNode);
 
@@ -204,6 +223,7 @@ void Search::clear() {
   Time.availableNodes = 0;
   TT.clear();
   Threads.clear();
+  Cluster::new_game();
   Tablebases::init(Options["SyzygyPath"]); // Free mapped files
 }
 
@@ -233,6 +253,8 @@ void MainThread::search() {
   }
   else
   {
+      UseAbdada = Options["SMP ABDADA"] && Threads.size() > 1;
+
       for (Thread* th : Threads)
       {
           th->bestMoveChanges = 0;
@@ -246,11 +268,10 @@ void MainThread::search() {
   // When we reach the maximum depth, we can arrive here without a raise of
   // Threads.stop. However, if we are pondering or in an infinite search,
   // the UCI protocol states that we shouldn't print the best move before the
-  // GUI sends a "stop" or "ponderhit" command. We therefore simply wait here
-  // until the GUI sends one of those commands.
+  // GUI sends a "stop" or "ponderhit" command. We therefore sleep here until
+  // the GUI sends one of those commands.
 
-  while (!Threads.stop && (ponder || Limits.infinite))
-  {} // Busy wait for a stop or a ponder reset
+  wait_for_stop_or_ponderhit();
 
   // Stop the threads if not already stopped (also raise the stop if
   // "ponderhit" just reset Threads.ponder).
@@ -301,6 +322,11 @@ void MainThread::search() {
 
   previousScore = bestThread->rootMoves[0].score;
 
+  // The workers of a cluster searched the other root moves, one of them may
+  // have a better result to report in our place.
+  if (Cluster::finish(bestThread->rootMoves[0].pv[0], previousScore, bestThread->completedDepth))
+      return;
+
   // Send again PV info if we have a new best thread
   if (bestThread != this)
       sync_cout << UCI::pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
@@ -365,6 +391,13 @@ void Thread::search() {
 
   int ct = int(Options["Contempt"]) * PawnValueEg / 100; // From centipawns
 
+  // Helper threads may skip some depths and center their aspiration windows
+  // below, on or above the previous score, so that they search different trees
+  // than the main thread.
+  const bool skipDepths = idx > 0 && Options["SMP Depth Skip"];
+  const Value windowShift = idx > 0 ? Value((int(idx % 3) - 1) * int(Options["SMP Window Offset"]) * PawnValueEg / 100)
+                                    : VALUE_ZERO; // From centipawns
+
   // Evaluation score is from the white point of view
   contempt = (us == WHITE ?  make_score(ct, ct / 2)
                           : -make_score(ct, ct / 2));
@@ -374,6 +407,14 @@ void Thread::search() {
          && !Threads.stop
          && !(Limits.depth && mainThread && rootDepth / ONE_PLY > Limits.depth))
   {
+      // Distribute search depths across the helper threads
+      if (skipDepths)
+      {
+          int i = (idx - 1) % 20;
+          if (((rootDepth / ONE_PLY + SkipPhase[i]) / SkipSize[i]) % 2)
+              continue;
+      }
+
       // Age out PV variability metric
       if (mainThread)
           totBestMoveChanges /= 2;
@@ -404,9 +445,10 @@ void Thread::search() {
           if (rootDepth >= 4 * ONE_PLY)
           {
               Value previousScore = rootMoves[pvIdx].previousScore;
+              Value center = previousScore + (abs(previousScore) < VALUE_KNOWN_WIN ? windowShift : VALUE_ZERO);
               delta = Value(23);
-              alpha = std::max(previousScore - delta,-VALUE_INFINITE);
-              beta  = std::min(previousScore + delta, VALUE_INFINITE);
+              alpha = std::max(center - delta,-VALUE_INFINITE);
+              beta  = std::min(center + delta, VALUE_INFINITE);
 
               // Adjust contempt based on root move's previousScore (dynamic contempt)
               int dct = ct + 86 * previousScore / (abs(previousScore) + 176);
@@ -533,6 +575,8 @@ void Thread::search() {
       }
   }
 
+  publish_counters();
+
   if (!mainThread)
       return;
 
@@ -577,9 +621,9 @@ namespace {
     assert(!(PvNode && cutNode));
     assert(depth / ONE_PLY * ONE_PLY == depth);
 
-    Move pv[MAX_PLY+1], capturesSearched[32], quietsSearched[64];
+    Move pv[MAX_PLY+1], capturesSearched[32], quietsSearched[64], deferredMoves[MaxDeferred];
     StateInfo st;
-    TTEntry* tte;
+    TTEntry tte;
     Key posKey;
     Move ttMove, move, excludedMove, bestMove;
     Depth extension, newDepth;
@@ -587,7 +631,7 @@ namespace {
     bool ttHit, ttPv, inCheck, givesCheck, improving, doLMR;
     bool captureOrPromotion, doFullDepthSearch, moveCountPruning, ttCapture;
     Piece movedPiece;
-    int moveCount, captureCount, quietCount, singularLMR;
+    int moveCount, captureCount, quietCount, singularLMR, deferredCount, deferredIdx;
 
     // Step 1. Initialize node
     Thread* thisThread = pos.this_thread();
@@ -649,18 +693,22 @@ namespace {
     excludedMove = ss->excludedMove;
     posKey = pos.key() ^ Key(excludedMove << 16); // Isn't a very good hash
     tte = TT.probe(posKey, ttHit);
-    ttValue = ttHit ? value_from_tt(tte->value(), ss->ply) : VALUE_NONE;
+#ifdef TT_STATS
+    thisThread->ttProbes++;
+    thisThread->ttHits += ttHit;
+#endif
+    ttValue = ttHit ? value_from_tt(tte.value(), ss->ply) : VALUE_NONE;
     ttMove =  rootNode ? thisThread->rootMoves[thisThread->pvIdx].pv[0]
-            : ttHit    ? tte->move() : MOVE_NONE;
-    ttPv = PvNode || (ttHit && tte->is_pv());
+            : ttHit    ? tte.move() : MOVE_NONE;
+    ttPv = PvNode || (ttHit && tte.is_pv());
 
     // At non-PV nodes we check for an early TT cutoff
     if (  !PvNode
         && ttHit
-        && tte->depth() >= depth
+        && tte.depth() >= depth
         && ttValue != VALUE_NONE // Possible in case of TT access race
-        && (ttValue >= beta ? (tte->bound() & BOUND_LOWER)
-                            : (tte->bound() & BOUND_UPPER)))
+        && (ttValue >= beta ? (tte.bound() & BOUND_LOWER)
+                            : (tte.bound() & BOUND_UPPER)))
     {
         // If ttMove is quiet, update move sorting heuristics on TT hit
         if (ttMove)
@@ -704,7 +752,7 @@ namespace {
 
             if (err != TB::ProbeState::FAIL)
             {
-                thisThread->tbHits.fetch_add(1, std::memory_order_relaxed);
+                thisThread->tbHits++;
 
                 int drawScore = TB::UseRule50 ? 1 : 0;
 
@@ -718,7 +766,7 @@ namespace {
                 if (    b == BOUND_EXACT
                     || (b == BOUND_LOWER ? value >= beta : value <= alpha))
                 {
-                    tte->save(posKey, value_to_tt(value, ss->ply), ttPv, b,
+                    tte.save(posKey, value_to_tt(value, ss->ply), ttPv, b,
                               std::min(DEPTH_MAX - ONE_PLY, depth + 6 * ONE_PLY),
                               MOVE_NONE, VALUE_NONE);
 
@@ -746,13 +794,13 @@ namespace {
     else if (ttHit)
     {
         // Never assume anything about values stored in TT
-        ss->staticEval = eval = tte->eval();
+        ss->staticEval = eval = tte.eval();
         if (eval == VALUE_NONE)
             ss->staticEval = eval = evaluate(pos);
 
         // Can ttValue be used as a better position evaluation?
         if (    ttValue != VALUE_NONE
-            && (tte->bound() & (ttValue > eval ? BOUND_LOWER : BOUND_UPPER)))
+            && (tte.bound() & (ttValue > eval ? BOUND_LOWER : BOUND_UPPER)))
             eval = ttValue;
     }
     else
@@ -766,7 +814,7 @@ namespace {
         else
             ss->staticEval = eval = -(ss-1)->staticEval + 2 * Eval::Tempo;
 
-        tte->save(posKey, VALUE_NONE, ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval);
+        tte.save(posKey, VALUE_NONE, ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval);
     }
 
     // Step 7. Razoring (~2 Elo)
@@ -878,8 +926,8 @@ namespace {
         search<NT>(pos, ss, alpha, beta, depth - 7 * ONE_PLY, cutNode);
 
         tte = TT.probe(posKey, ttHit);
-        ttValue = ttHit ? value_from_tt(tte->value(), ss->ply) : VALUE_NONE;
-        ttMove = ttHit ? tte->move() : MOVE_NONE;
+        ttValue = ttHit ? value_from_tt(tte.value(), ss->ply) : VALUE_NONE;
+        ttMove = ttHit ? tte.move() : MOVE_NONE;
     }
 
 moves_loop: // When in check, search starts from here
@@ -898,14 +946,16 @@ moves_loop: // When in check, search starts from here
 
     value = bestValue; // Workaround a bogus 'uninitialized' warning under gcc
     moveCountPruning = false;
+    deferredCount = deferredIdx = 0;
     ttCapture = ttMove && pos.capture_or_promotion(ttMove);
 
     // Mark this node as being searched.
     ThreadHolding th(thisThread, posKey, ss->ply);
 
     // Step 12. Loop through all pseudo-legal moves until no moves remain
-    // or a beta cutoff occurs.
-    while ((move = mp.next_move(moveCountPruning)) != MOVE_NONE)
+    // or a beta cutoff occurs. Moves deferred with ABDADA come last.
+    while (   (move = mp.next_move(moveCountPruning)) != MOVE_NONE
+           || (deferredIdx < deferredCount && (move = deferredMoves[deferredIdx++]) != MOVE_NONE))
     {
       assert(is_ok(move));
 
@@ -947,8 +997,8 @@ moves_loop: // When in check, search starts from here
           && !excludedMove // Avoid recursive singular search
        /* &&  ttValue != VALUE_NONE Already implicit in the next condition */
           &&  abs(ttValue) < VALUE_KNOWN_WIN
-          && (tte->bound() & BOUND_LOWER)
-          &&  tte->depth() >= depth - 3 * ONE_PLY
+          && (tte.bound() & BOUND_LOWER)
+          &&  tte.depth() >= depth - 3 * ONE_PLY
           &&  pos.legal(move))
       {
           Value singularBeta = ttValue - 2 * depth / ONE_PLY;
@@ -1041,6 +1091,24 @@ moves_loop: // When in check, search starts from here
           continue;
       }
 
+      // ABDADA: defer a move another thread is searching, but never the first
+      // one of a node or a move which was already deferred.
+      Key moveKey = 0;
+      if (UseAbdada && depth >= AbdadaDepth * ONE_PLY)
+      {
+          moveKey = pos.key_after(move);
+
+          if (   moveCount > 1
+              && !deferredIdx
+              && deferredCount < MaxDeferred
+              && searching_move(moveKey).load(std::memory_order_relaxed) == moveKey)
+          {
+              deferredMoves[deferredCount++] = move;
+              ss->moveCount = --moveCount;
+              continue;
+          }
+      }
+
       // Update the current move (this must be done after singular extension search)
       ss->currentMove = move;
       ss->continuationHistory = &thisThread->continuationHistory[movedPiece][to_sq(move)];
@@ -1048,6 +1116,9 @@ moves_loop: // When in check, search starts from here
       // Step 15. Make the move
       pos.do_move(move, st, givesCheck);
 
+      if (moveKey)
+          searching_move(moveKey).store(moveKey, std::memory_order_relaxed);
+
       // Step 16. Reduced depth search (LMR). If the move fails high it will be
       // re-searched at full depth.
       if (    depth >= 3 * ONE_PLY
@@ -1153,6 +1224,9 @@ moves_loop: // When in check, search starts from here
       // Step 18. Undo move
       pos.undo_move(move);
 
+      if (moveKey) // Unless another thread has taken the slot since
+          searching_move(moveKey).compare_exchange_strong(moveKey, 0, std::memory_order_relaxed);
+
       assert(value > -VALUE_INFINITE && value < VALUE_INFINITE);
 
       // Step 19. Check for a new best move
@@ -1266,10 +1340,18 @@ moves_loop: // When in check, search starts from here
         bestValue = std::min(bestValue, maxValue);
 
     if (!excludedMove)
-        tte->save(posKey, value_to_tt(bestValue, ss->ply), ttPv,
-                  bestValue >= beta ? BOUND_LOWER :
-                  PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER,
-                  depth, bestMove, ss->staticEval);
+    {
+        Bound b =  bestValue >= beta ? BOUND_LOWER
+                 : PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER;
+
+        tte.save(posKey, value_to_tt(bestValue, ss->ply), ttPv, b,
+                 depth, bestMove, ss->staticEval);
+
+        if (   depth >= Cluster::ShareDepth
+            && Cluster::Sharing.load(std::memory_order_relaxed))
+            Cluster::share(thisThread->id(), posKey, value_to_tt(bestValue, ss->ply), ttPv, b,
+                           depth, bestMove, ss->staticEval);
+    }
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1291,7 +1373,7 @@ moves_loop: // When in check, search starts from here
 
     Move pv[MAX_PLY+1];
     StateInfo st;
-    TTEntry* tte;
+    TTEntry tte;
     Key posKey;
     Move ttMove, move, bestMove;
     Depth ttDepth;
@@ -1327,16 +1409,20 @@ moves_loop: // When in check, search starts from here
     // Transposition table lookup
     posKey = pos.key();
     tte = TT.probe(posKey, ttHit);
-    ttValue = ttHit ? value_from_tt(tte->value(), ss->ply) : VALUE_NONE;
-    ttMove = ttHit ? tte->move() : MOVE_NONE;
-    pvHit = ttHit && tte->is_pv();
+#ifdef TT_STATS
+    thisThread->ttProbes++;
+    thisThread->ttHits += ttHit;
+#endif
+    ttValue = ttHit ? value_from_tt(tte.value(), ss->ply) : VALUE_NONE;
+    ttMove = ttHit ? tte.move() : MOVE_NONE;
+    pvHit = ttHit && tte.is_pv();
 
     if (  !PvNode
         && ttHit
-        && tte->depth() >= ttDepth
+        && tte.depth() >= ttDepth
         && ttValue != VALUE_NONE // Only in case of TT access race
-        && (ttValue >= beta ? (tte->bound() & BOUND_LOWER)
-                            : (tte->bound() & BOUND_UPPER)))
+        && (ttValue >= beta ? (tte.bound() & BOUND_LOWER)
+                            : (tte.bound() & BOUND_UPPER)))
         return ttValue;
 
     // Evaluate the position statically
@@ -1350,12 +1436,12 @@ moves_loop: // When in check, search starts from here
         if (ttHit)
         {
             // Never assume anything about values stored in TT
-            if ((ss->staticEval = bestValue = tte->eval()) == VALUE_NONE)
+            if ((ss->staticEval = bestValue = tte.eval()) == VALUE_NONE)
                 ss->staticEval = bestValue = evaluate(pos);
 
             // Can ttValue be used as a better position evaluation?
             if (    ttValue != VALUE_NONE
-                && (tte->bound() & (ttValue > bestValue ? BOUND_LOWER : BOUND_UPPER)))
+                && (tte.bound() & (ttValue > bestValue ? BOUND_LOWER : BOUND_UPPER)))
                 bestValue = ttValue;
         }
         else
@@ -1367,7 +1453,7 @@ moves_loop: // When in check, search starts from here
         if (bestValue >= beta)
         {
             if (!ttHit)
-                tte->save(posKey, value_to_tt(bestValue, ss->ply), pvHit, BOUND_LOWER,
+                tte.save(posKey, value_to_tt(bestValue, ss->ply), pvHit, BOUND_LOWER,
                           DEPTH_NONE, MOVE_NONE, ss->staticEval);
 
             return bestValue;
@@ -1479,7 +1565,7 @@ moves_loop: // When in check, search starts from here
     if (inCheck && bestValue == -VALUE_INFINITE)
         return mated_in(ss->ply); // Plies to mate from the root
 
-    tte->save(posKey, value_to_tt(bestValue, ss->ply), pvHit,
+    tte.save(posKey, value_to_tt(bestValue, ss->ply), pvHit,
               bestValue >= beta ? BOUND_LOWER :
               PvNode && bestValue > oldAlpha  ? BOUND_EXACT : BOUND_UPPER,
               ttDepth, bestMove, ss->staticEval);
@@ -1636,6 +1722,10 @@ void MainThread::check_time() {
 
   static TimePoint lastInfoTime = now();
 
+  // Our own counts must be exact for the nodes limit and in 'nodes as time'
+  // mode, the helpers' ones lag behind by less than 1024 nodes each.
+  publish_counters();
+
   TimePoint elapsed = Time.elapsed();
   TimePoint tick = Limits.startTime + elapsed;
 
@@ -1645,6 +1735,8 @@ void MainThread::check_time() {
       dbg_print();
   }
 
+  Cluster::flush();
+
   // We should not stop pondering until told so by the GUI
   if (ponder)
       return;
@@ -1661,6 +1753,8 @@ void MainThread::check_time() {
 
 string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
 
+  pos.this_thread()->publish_counters(); // Exact counts at low depths too
+
   std::stringstream ss;
   TimePoint elapsed = Time.elapsed() + 1;
   const RootMoves& rootMoves = pos.this_thread()->rootMoves;
@@ -1728,11 +1822,11 @@ bool RootMove::extract_ponder_from_tt(Position& pos) {
         return false;
 
     pos.do_move(pv[0], st);
-    TTEntry* tte = TT.probe(pos.key(), ttHit);
+    TTEntry tte = TT.probe(pos.key(), ttHit);
 
     if (ttHit)
     {
-        Move m = tte->move(); // Local copy to be SMP safe
+        Move m = tte.move(); // Local copy to be SMP safe
         if (MoveList<LEGAL>(pos).contains(m))
             pv.push_back(m);
     }
@@ -19,8 +19,11 @@
 */
 
 #include <cassert>
+#include <cstdlib>   // For std::exit
+#include <iostream>
 
 #include <algorithm> // For std::count
+#include "cluster.h"
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
@@ -53,6 +56,27 @@ Thread::~Thread() {
 }
 
 
+/// Thread::operator new() and Thread::operator delete() take the memory of a
+/// Thread object from fresh pages, see the Thread class.
+
+void* Thread::operator new(size_t size) {
+
+  void* mem = fresh_pages_alloc(size);
+
+  if (!mem)
+  {
+      std::cerr << "Failed to allocate a thread" << std::endl;
+      std::exit(EXIT_FAILURE);
+  }
+
+  return mem;
+}
+
+void Thread::operator delete(void* mem, size_t size) {
+  fresh_pages_free(mem, size);
+}
+
+
 /// Thread::clear() reset histories, usually before a new game
 
 void Thread::clear() {
@@ -88,6 +112,37 @@ void Thread::wait_for_search_finished() {
 }
 
 
+/// Thread::run_custom_job() wakes up the thread in idle_loop() to run f instead
+/// of a search, and returns immediately. Use wait_for_search_finished() to wait
+/// for the job to complete.
+
+void Thread::run_custom_job(std::function<void()> f) {
+
+  {
+      std::lock_guard<Mutex> lk(mutex);
+      jobFunc = std::move(f);
+  }
+
+  start_searching();
+}
+
+
+/// Thread::bind() makes the thread bind itself to its CPU, and waits until it
+/// has done so. Thread::unbind() undoes it.
+
+void Thread::bind() {
+
+  run_custom_job([this]() { WinProcGroup::bindThisThread(idx); });
+  wait_for_search_finished();
+}
+
+void Thread::unbind() {
+
+  run_custom_job([]() { WinProcGroup::unbindThisThread(); });
+  wait_for_search_finished();
+}
+
+
 /// Thread::idle_loop() is where the thread is parked, blocked on the
 /// condition variable, when it has no work to do.
 
@@ -101,6 +156,8 @@ void Thread::idle_loop() {
   if (Options["Threads"] > 8)
       WinProcGroup::bindThisThread(idx);
 
+  clear(); // First touch of the histories, see the Thread class
+
   while (true)
   {
       std::unique_lock<Mutex> lk(mutex);
@@ -113,41 +170,99 @@ void Thread::idle_loop() {
 
       lk.unlock();
 
+      if (jobFunc)
+      {
+          std::function<void()> job = std::move(jobFunc);
+          jobFunc = nullptr;
+          job();
+          continue;
+      }
+
       search();
   }
 }
 
+/// MainThread::wait_for_stop_or_ponderhit() is called by the main thread when
+/// it has finished searching but must not report its best move yet, because
+/// we are pondering or in an infinite search. It sleeps on a condition variable
+/// until the GUI sends "stop" or "ponderhit" (or "quit").
+
+void MainThread::wait_for_stop_or_ponderhit() {
+
+  std::unique_lock<Mutex> lk(waitMutex);
+  waitCv.wait(lk, [&]{ return Threads.stop || !(ponder || Search::Limits.infinite); });
+}
+
+
+/// MainThread::on_stop_or_ponderhit() wakes up the main thread waiting in
+/// wait_for_stop_or_ponderhit(). The caller must have already raised
+/// Threads.stop or reset ponder. Taking the mutex here guarantees the main
+/// thread is either still before its predicate check or already sleeping,
+/// so the notification can't get lost.
+
+void MainThread::on_stop_or_ponderhit() {
+
+  std::lock_guard<Mutex> lk(waitMutex);
+  waitCv.notify_one();
+}
+
+
 /// ThreadPool::set() creates/destroys threads to match the requested number.
 /// Created and launched threads will immediately go to sleep in idle_loop.
-/// Upon resizing, threads are recreated to allow for binding if necessary.
+/// Upon resizing, the existing threads are kept with their histories and only
+/// the difference is created or destroyed.
 
 void ThreadPool::set(size_t requested) {
 
-  if (size() > 0) { // destroy any existing thread(s)
+  TimePoint elapsed = now();
+  const size_t previous = size();
+
+  if (previous > 0)
       main()->wait_for_search_finished();
 
-      while (size() > 0)
-          delete back(), pop_back();
-  }
+  while (size() > requested) // destroy extra thread(s)
+      delete back(), pop_back();
+
+  // Threads bind themselves when there are more than 8 of them, see idle_loop(),
+  // so the ones created unbound must do it now, and the ones kept when going
+  // back to 8 or fewer must be released, as if the pool had been recreated.
+  if (previous <= 8 && requested > 8)
+      for (Thread* th : *this)
+          th->bind();
+
+  if (previous > 8 && requested <= 8)
+      for (Thread* th : *this)
+          th->unbind();
 
   if (requested > 0) { // create new thread(s)
-      push_back(new MainThread(0));
+      if (empty())
+      {
+          push_back(new MainThread(0));
+          clear();
+      }
 
       while (size() < requested)
           push_back(new Thread(size()));
-      clear();
 
-      // Reallocate the hash with the new threadpool size
+      // Allocate the hash on the first call, later ones keep its contents
       TT.resize(Options["Hash"]);
   }
+
+  if (previous > 0 && requested > 0 && requested != previous)
+      sync_cout << "info string Threads " << previous << " -> " << requested
+                << " in " << now() - elapsed << " ms" << sync_endl;
 }
 
-/// ThreadPool::clear() sets threadPool data to initial values.
+/// ThreadPool::clear() sets threadPool data to initial values. Each thread
+/// clears its own histories, all in parallel.
 
 void ThreadPool::clear() {
 
   for (Thread* th : *this)
-      th->clear();
+      th->run_custom_job([th]() { th->clear(); });
+
+  for (Thread* th : *this)
+      th->wait_for_search_finished();
 
   main()->callsCnt = 0;
   main()->previousScore = VALUE_INFINITE;
@@ -175,6 +290,8 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   if (!rootMoves.empty())
       Tablebases::rank_root_moves(pos, rootMoves);
 
+  Cluster::start(rootMoves, limits);
+
   // After ownership transfer 'states' becomes empty, so if we stop the search
   // and call 'go' again without setting a new position states.get() == NULL.
   assert(states.get() || setupStates.get());
@@ -184,20 +301,22 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
 
   // We use Position::set() to set root position across threads. But there are
   // some StateInfo fields (previous, pliesFromNull, capturedPiece) that cannot
-  // be deduced from a fen string, so set() clears them and to not lose the info
-  // we need to backup and later restore setupStates->back(). Note that setupStates
-  // is shared by threads but is accessed in read-only mode.
-  StateInfo tmp = setupStates->back();
-
+  // be deduced from a fen string, so set() clears them and they are set from
+  // setupStates->back() later. The rootState is per thread because the search
+  // writes its NNUE accumulator, earlier states are shared since they are
+  // only read.
   for (Thread* th : *this)
   {
       th->shuffleExts = th->nodes = th->tbHits = th->nmpMinPly = 0;
+#ifdef TT_STATS
+      th->ttProbes = th->ttHits = 0;
+#endif
+      th->sharedNodes = th->sharedTbHits = 0;
       th->rootDepth = th->completedDepth = DEPTH_ZERO;
       th->rootMoves = rootMoves;
-      th->rootPos.set(pos.fen(), pos.is_chess960(), &setupStates->back(), th);
+      th->rootPos.set(pos.fen(), pos.is_chess960(), &th->rootState, th);
+      th->rootState = setupStates->back();
   }
 
-  setupStates->back() = tmp;
-
   main()->start_searching();
 }
@@ -23,6 +23,7 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -39,6 +40,11 @@
 /// per-thread pawn and material hash tables so that once we get a
 /// pointer to an entry its life time is unlimited and we don't have
 /// to care about someone changing the entry under our feet.
+///
+/// Thread objects are mapped straight from the OS, and a thread clears its
+/// histories itself before going idle for the first time, so on NUMA systems
+/// their pages are first touched, and thus placed, on the node of the thread
+/// using them.
 
 class Thread {
 
@@ -46,25 +52,41 @@ class Thread {
   ConditionVariable cv;
   size_t idx;
   bool exit = false, searching = true; // Set before starting std::thread
+  std::function<void()> jobFunc; // Run by idle_loop() instead of a search
   NativeThread stdThread;
 
 public:
   explicit Thread(size_t);
   virtual ~Thread();
+  static void* operator new(size_t size);
+  static void operator delete(void* mem, size_t size);
   virtual void search();
   void clear();
   void idle_loop();
   void start_searching();
   void wait_for_search_finished();
+  void run_custom_job(std::function<void()> f);
+  void bind();
+  void unbind();
+  size_t id() const { return idx; }
+  void publish_counters() {
+    sharedNodes.store(nodes, std::memory_order_relaxed);
+    sharedTbHits.store(tbHits, std::memory_order_relaxed);
+  }
 
   Pawns::Table pawnsTable;
-  Material::Table materialTable;
+  Material::Entry materialEntry; // Last entry returned by Material::probe()
   size_t pvIdx, pvLast, shuffleExts;
   int selDepth, nmpMinPly;
   Color nmpColor;
-  std::atomic<uint64_t> nodes, tbHits, bestMoveChanges;
+  uint64_t nodes, tbHits; // Only touched by this thread, see publish_counters()
+#ifdef TT_STATS
+  uint64_t ttProbes, ttHits; // For bench, read once the search is finished
+#endif
+  std::atomic<uint64_t> bestMoveChanges;
 
   Position rootPos;
+  StateInfo rootState;
   Search::RootMoves rootMoves;
   Depth rootDepth, completedDepth;
   CounterMoveHistory counterMoves;
@@ -72,6 +94,11 @@ public:
   CapturePieceToHistory captureHistory;
   ContinuationHistory continuationHistory;
   Score contempt;
+
+  // Copies of nodes and tbHits for the other threads, updated every 1024 nodes
+  // and at the end of the search. They get a cache line of their own, so that
+  // reading them does not disturb the writes to the hot fields above.
+  alignas(64) std::atomic<uint64_t> sharedNodes, sharedTbHits;
 };
 
 
@@ -83,12 +110,18 @@ struct MainThread : public Thread {
 
   void search() override;
   void check_time();
+  void wait_for_stop_or_ponderhit();
+  void on_stop_or_ponderhit();
 
   double previousTimeReduction;
   Value previousScore;
   int callsCnt;
   bool stopOnPonderhit;
   std::atomic_bool ponder;
+
+private:
+  Mutex waitMutex;
+  ConditionVariable waitCv;
 };
 
 
@@ -103,8 +136,8 @@ struct ThreadPool : public std::vector<Thread*> {
   void set(size_t);
 
   MainThread* main()        const { return static_cast<MainThread*>(front()); }
-  uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
-  uint64_t tb_hits()        const { return accumulate(&Thread::tbHits); }
+  uint64_t nodes_searched() const { return accumulate(&Thread::sharedNodes); }
+  uint64_t tb_hits()        const { return accumulate(&Thread::sharedTbHits); }
 
   std::atomic_bool stop;
 
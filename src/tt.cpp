@@ -18,9 +18,18 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cmath>
 #include <cstring>   // For std::memset
+#include <fstream>
 #include <iostream>
 #include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "bitboard.h"
 #include "misc.h"
@@ -30,55 +39,342 @@
 
 TranspositionTable TT; // Our global transposition table
 
-/// TTEntry::save populates the TTEntry with a new node's data, possibly
+namespace {
+
+  // A saved table is a header padded to one page, so that the clusters are page
+  // aligned when the file is mapped back, followed by the clusters exactly as
+  // they are laid out in memory. Files are therefore specific to the build.
+  constexpr size_t HeaderSize = 4096;
+  constexpr uint32_t FileVersion = 1;
+  constexpr char FileMagic[8] = { 'B', 'C', 'M', 'K', '-', 'T', 'T', '\0' };
+
+  struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t clusterSize;
+    uint64_t clusterCount;
+    uint8_t generation8;
+  };
+
+  static_assert(sizeof(FileHeader) <= HeaderSize, "TT file header too big");
+
+  // cluster_index() returns the cluster of a key in a table of the given size,
+  // from the 32 lowest order bits of the key as in first_entry().
+  size_t cluster_index(uint64_t key32, size_t clusterCount) {
+    return (key32 * clusterCount) >> 32;
+  }
+
+  // parallel_for() splits the range [0, count) in one part for each search
+  // thread and calls f(start, len) for every part in a thread of its own.
+  template<typename F>
+  void parallel_for(size_t count, F f) {
+
+    const size_t threadCount = size_t(Options["Threads"]);
+    std::vector<std::thread> threads;
+
+    for (size_t idx = 0; idx < threadCount; ++idx)
+    {
+        threads.emplace_back([=]() {
+
+            // Thread binding gives faster search on systems with a first-touch policy
+            if (threadCount > 8)
+                WinProcGroup::bindThisThread(idx);
+
+            const size_t stride = count / threadCount,
+                         start  = stride * idx,
+                         len    = idx != threadCount - 1 ?
+                                  stride : count - start;
+            f(start, len);
+        });
+    }
+
+    for (std::thread& th : threads)
+        th.join();
+  }
+
+} // namespace
+
+#ifndef LOCKLESS_TT
+
+/// TTEntry::save populates the slot with a new node's data, possibly
 /// overwriting an old position. Update is not atomic and can be racy.
 
 void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
 
   assert(d / ONE_PLY * ONE_PLY == d);
 
+  // In the two-tier scheme a shallower position does not evict a deeper one of
+  // the current search but goes to the always-replace slot of the cluster.
+  if (   spare
+      && (k >> 48) != slot->key16
+      && (d - DEPTH_OFFSET) / ONE_PLY < slot->data.depth8
+      && (slot->data.genBound8 & 0xF8) == TT.generation8)
+      slot = spare;
+
+  TTData& data = slot->data;
+
   // Preserve any existing move for the same position
-  if (m || (k >> 48) != key16)
-      move16 = (uint16_t)m;
+  if (m || (k >> 48) != slot->key16)
+      data.move16 = (uint16_t)m;
 
   // Overwrite less valuable entries
-  if (  (k >> 48) != key16
-      ||(d - DEPTH_OFFSET) / ONE_PLY > depth8 - 4
+  if (  (k >> 48) != slot->key16
+      ||(d - DEPTH_OFFSET) / ONE_PLY > data.depth8 - 4
       || b == BOUND_EXACT)
   {
       assert((d - DEPTH_OFFSET) / ONE_PLY >= 0);
 
-      key16     = (uint16_t)(k >> 48);
-      value16   = (int16_t)v;
-      eval16    = (int16_t)ev;
-      genBound8 = (uint8_t)(TT.generation8 | uint8_t(pv) << 2 | b);
-      depth8    = (uint8_t)((d - DEPTH_OFFSET) / ONE_PLY);
+      slot->key16    = (uint16_t)(k >> 48);
+      data.value16   = (int16_t)v;
+      data.eval16    = (int16_t)ev;
+      data.genBound8 = (uint8_t)(TT.generation8 | uint8_t(pv) << 2 | b);
+      data.depth8    = (uint8_t)((d - DEPTH_OFFSET) / ONE_PLY);
   }
 }
 
+#else
+
+namespace {
+
+  TTData unpack(uint64_t w) {
+    TTData data;
+    std::memcpy(&data, &w, sizeof(data));
+    return data;
+  }
+
+  uint64_t pack(const TTData& data) {
+    uint64_t w;
+    std::memcpy(&w, &data, sizeof(w));
+    return w;
+  }
+
+  // write() publishes new contents for the position with key k
+  void write(TTSlot* slot, Key k, const TTData& data) {
+    uint64_t w = pack(data);
+    slot->data.store(w, std::memory_order_relaxed);
+    slot->keyXorData.store(k ^ w, std::memory_order_relaxed);
+  }
+
+} // namespace
+
+/// TTEntry::save populates the slot with a new node's data, possibly
+/// overwriting an old position. The same rules as for the default table apply,
+/// based on the current contents of the slot and comparing full keys.
+
+void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
+
+  assert(d / ONE_PLY * ONE_PLY == d);
+
+  uint64_t w = slot->data.load(std::memory_order_relaxed);
+  bool samePosition = (slot->keyXorData.load(std::memory_order_relaxed) ^ w) == k;
+  TTData cur = unpack(w);
+
+  // Two-tier scheme, see the default table
+  if (   spare
+      && !samePosition
+      && (d - DEPTH_OFFSET) / ONE_PLY < cur.depth8
+      && (cur.genBound8 & 0xF8) == TT.generation8)
+  {
+      slot = spare;
+      w = slot->data.load(std::memory_order_relaxed);
+      samePosition = (slot->keyXorData.load(std::memory_order_relaxed) ^ w) == k;
+      cur = unpack(w);
+  }
+
+  // Preserve any existing move for the same position
+  if (m || !samePosition)
+      cur.move16 = (uint16_t)m;
+
+  // Overwrite less valuable entries
+  if (   !samePosition
+      || (d - DEPTH_OFFSET) / ONE_PLY > cur.depth8 - 4
+      || b == BOUND_EXACT)
+  {
+      assert((d - DEPTH_OFFSET) / ONE_PLY >= 0);
+
+      cur.value16   = (int16_t)v;
+      cur.eval16    = (int16_t)ev;
+      cur.genBound8 = (uint8_t)(TT.generation8 | uint8_t(pv) << 2 | b);
+      cur.depth8    = (uint8_t)((d - DEPTH_OFFSET) / ONE_PLY);
+  }
+
+  write(slot, k, cur);
+}
+
+#endif
+
+namespace {
+
+  // read_slot() copies the key and the data of a slot, it returns false if the
+  // slot is empty. write_slot() stores them back. The default table only keeps
+  // the 16 highest bits of the key.
+
+#ifndef LOCKLESS_TT
+
+  bool read_slot(const TTSlot& slot, Key& key, TTData& data) {
+    key = slot.key16;
+    data = slot.data;
+    return key != 0;
+  }
+
+  void write_slot(TTSlot& slot, Key key, const TTData& data) {
+    slot.key16 = uint16_t(key);
+    slot.data = data;
+  }
+
+#else
+
+  bool read_slot(const TTSlot& slot, Key& key, TTData& data) {
+    uint64_t w = slot.data.load(std::memory_order_relaxed);
+    key = slot.keyXorData.load(std::memory_order_relaxed) ^ w;
+    data = unpack(w);
+    return key || w;
+  }
+
+  void write_slot(TTSlot& slot, Key key, const TTData& data) {
+    write(&slot, key, data);
+  }
+
+#endif
+
+} // namespace
+
 
 /// TranspositionTable::resize() sets the size of the transposition table,
 /// measured in megabytes. Transposition table consists of a power of 2 number
 /// of clusters and each cluster consists of ClusterSize number of TTEntry.
+/// The entries of the current table are moved to the new one, nothing is done
+/// if the size does not change.
 
 void TranspositionTable::resize(size_t mbSize) {
 
   Threads.main()->wait_for_search_finished();
 
-  clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
+  const size_t newClusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
+
+  if (table && newClusterCount == clusterCount)
+      return;
 
-  free(mem);
-  mem = malloc(clusterCount * sizeof(Cluster) + CacheLineSize - 1);
+  Cluster* newTable = static_cast<Cluster*>(aligned_large_pages_alloc(newClusterCount * sizeof(Cluster)));
 
-  if (!mem)
+  // Without room for both tables start again from an empty one
+  if (!newTable && table)
+  {
+      free_table();
+      newTable = static_cast<Cluster*>(aligned_large_pages_alloc(newClusterCount * sizeof(Cluster)));
+  }
+
+  if (!newTable)
   {
       std::cerr << "Failed to allocate " << mbSize
                 << "MB for transposition table." << std::endl;
       exit(EXIT_FAILURE);
   }
 
-  table = (Cluster*)((uintptr_t(mem) + CacheLineSize - 1) & ~(CacheLineSize - 1));
-  clear();
+  if (!table)
+  {
+      table = newTable;
+      clusterCount = newClusterCount;
+      clear();
+      return;
+  }
+
+  TimePoint elapsed = now();
+
+  // Each thread fills its own part of the new table, so no cluster is written
+  // by two threads.
+  parallel_for(newClusterCount, [&](size_t start, size_t len) {
+
+      std::memset(static_cast<void*>(&newTable[start]), 0, len * sizeof(Cluster));
+
+      for (size_t idx = start; idx < start + len; ++idx)
+          migrate(newTable, newClusterCount, idx);
+  });
+
+  dbg_log(  "TT resize: " + std::to_string(clusterCount * sizeof(Cluster) >> 20)
+          + " MB to " + std::to_string(mbSize) + " MB in "
+          + std::to_string(now() - elapsed) + " ms");
+
+  free_table();
+  table = newTable;
+  clusterCount = newClusterCount;
+}
+
+
+/// TranspositionTable::migrate() fills cluster idx of a new table of the given
+/// size with the entries of the current table whose keys can map to it. The
+/// clusters cover consecutive ranges of the 32 lowest order bits of the keys,
+/// so these entries come from the one or few clusters covering the same range.
+/// The default table cannot tell which of the new clusters an entry belongs to
+/// when the table grows, so it is copied to all of them and the extra copies
+/// are replaced over time. When several entries compete for a slot the most
+/// valuable ones are kept, see replace_value().
+
+void TranspositionTable::migrate(Cluster* to, size_t toCount, size_t idx) const {
+
+  // The range of key32 values mapping to cluster idx in the new table
+  const uint64_t firstKey = ((uint64_t(idx) << 32) + toCount - 1) / toCount;
+  const uint64_t lastKey  = idx + 1 < toCount ? ((uint64_t(idx + 1) << 32) + toCount - 1) / toCount - 1
+                                              : 0xFFFFFFFF;
+  TTSlot* const tte = to[idx].entry;
+
+  for (size_t i = cluster_index(firstKey, clusterCount); i <= cluster_index(lastKey, clusterCount); ++i)
+      for (const TTSlot& src : table[i].entry)
+      {
+          Key key;
+          TTData data;
+
+          if (!read_slot(src, key, data))
+              continue;
+
+#ifdef LOCKLESS_TT
+          if (cluster_index(uint32_t(key), toCount) != idx)
+              continue;
+#endif
+
+          // Take the slot of the same key or an empty one, else the least valuable
+          int replace = 0;
+          bool empty = false;
+          TTData old[ClusterSize];
+
+          for (int j = 0; j < ClusterSize; ++j)
+          {
+              Key k;
+              empty = !read_slot(tte[j], k, old[j]);
+
+              if (empty || k == key)
+              {
+                  replace = j;
+                  break;
+              }
+
+              if (replace_value(old[j]) < replace_value(old[replace]))
+                  replace = j;
+          }
+
+          if (empty || replace_value(old[replace]) < replace_value(data))
+              write_slot(tte[replace], key, data);
+      }
+}
+
+
+/// TranspositionTable::free_table() releases the memory of the table, which is
+/// either a large pages allocation or a file mapped by load().
+
+void TranspositionTable::free_table() {
+
+#ifndef _WIN32
+  if (mappedFile)
+  {
+      munmap(mappedFile, mappedSize);
+      mappedFile = nullptr;
+      table = nullptr;
+      return;
+  }
+#endif
+
+  aligned_large_pages_free(table);
+  table = nullptr;
 }
 
 
@@ -87,43 +383,128 @@ void TranspositionTable::resize(size_t mbSize) {
 
 void TranspositionTable::clear() {
 
-  std::memset(table, 0, clusterCount * sizeof(Cluster));
+  TimePoint elapsed = now();
+
+  // Each thread will zero its part of the hash table
+  parallel_for(clusterCount, [this](size_t start, size_t len) {
+      std::memset(static_cast<void*>(&table[start]), 0, len * sizeof(Cluster));
+  });
+
+#ifdef LOCKLESS_TT
+  rejectedHits = 0;
+#endif
+
+  dbg_log(  "TT clear: " + std::to_string(clusterCount * sizeof(Cluster) >> 20)
+          + " MB with " + std::to_string(size_t(Options["Threads"])) + " threads in "
+          + std::to_string(now() - elapsed) + " ms");
+}
+
+/// TranspositionTable::set_replace_policy() sets the replacement strategy from
+/// the value of the "TT Replace" option.
+
+void TranspositionTable::set_replace_policy(const std::string& name) {
+
+  replacePolicy = name == "Age"      ? REPLACE_AGE
+                : name == "Two-tier" ? REPLACE_TWO_TIER
+                                     : REPLACE_DEPTH;
+}
+
+
+/// TranspositionTable::replace_value() returns how valuable an entry is to keep
+/// when a cluster is full, the least valuable one is replaced. It is the depth
+/// minus 8 times the relative age of the entry, or minus 32 times the relative
+/// age with REPLACE_AGE, so that entries of past searches go first even if they
+/// are much deeper.
+
+int TranspositionTable::replace_value(const TTData& data) const {
+
+  // Due to our packed storage format for generation and its cyclic
+  // nature we add 263 (256 is the modulus plus 7 to keep the unrelated
+  // lowest three bits from affecting the result) to calculate the entry
+  // age correctly even after generation8 overflows into the next cycle.
+  int age = (263 + generation8 - data.genBound8) & 0xF8;
+
+  return data.depth8 - (replacePolicy == REPLACE_AGE ? 4 * age : age);
 }
 
+
 /// TranspositionTable::probe() looks up the current position in the transposition
-/// table. It returns true and a pointer to the TTEntry if the position is found.
-/// Otherwise, it returns false and a pointer to an empty or least valuable TTEntry
-/// to be replaced later. The replace value of an entry is calculated as its depth
-/// minus 8 times its relative age. TTEntry t1 is considered more valuable than
-/// TTEntry t2 if its replace value is greater than that of t2.
+/// table. It returns true and a TTEntry for its slot if the position is found.
+/// Otherwise, it returns false and a TTEntry for an empty or least valuable slot
+/// to be replaced later, see replace_value(). With REPLACE_TWO_TIER the last slot
+/// of a cluster is not a candidate, it takes the positions save() does not want
+/// to store over a deeper entry of the current search.
+
+#ifndef LOCKLESS_TT
 
-TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
+TTEntry TranspositionTable::probe(const Key key, bool& found) const {
 
-  TTEntry* const tte = first_entry(key);
+  TTSlot* const tte = first_entry(key);
   const uint16_t key16 = key >> 48;  // Use the high 16 bits as key inside the cluster
 
   for (int i = 0; i < ClusterSize; ++i)
       if (!tte[i].key16 || tte[i].key16 == key16)
       {
-          tte[i].genBound8 = uint8_t(generation8 | (tte[i].genBound8 & 0x7)); // Refresh
+          TTData& data = tte[i].data;
+          data.genBound8 = uint8_t(generation8 | (data.genBound8 & 0x7)); // Refresh
 
-          return found = (bool)tte[i].key16, &tte[i];
+          return found = (bool)tte[i].key16, TTEntry(&tte[i], nullptr);
       }
 
   // Find an entry to be replaced according to the replacement strategy
-  TTEntry* replace = tte;
-  for (int i = 1; i < ClusterSize; ++i)
-      // Due to our packed storage format for generation and its cyclic
-      // nature we add 263 (256 is the modulus plus 7 to keep the unrelated
-      // lowest three bits from affecting the result) to calculate the entry
-      // age correctly even after generation8 overflows into the next cycle.
-      if (  replace->depth8 - ((263 + generation8 - replace->genBound8) & 0xF8)
-          >   tte[i].depth8 - ((263 + generation8 -   tte[i].genBound8) & 0xF8))
+  const bool twoTier = replacePolicy == REPLACE_TWO_TIER;
+  TTSlot* replace = tte;
+  for (int i = 1; i < ClusterSize - twoTier; ++i)
+      if (replace_value(replace->data) > replace_value(tte[i].data))
           replace = &tte[i];
 
-  return found = false, replace;
+  return found = false, TTEntry(replace, twoTier ? &tte[ClusterSize - 1] : nullptr);
 }
 
+#else
+
+TTEntry TranspositionTable::probe(const Key key, bool& found) const {
+
+  TTSlot* const tte = first_entry(key);
+  TTData data[ClusterSize];
+
+  for (int i = 0; i < ClusterSize; ++i)
+  {
+      uint64_t w = tte[i].data.load(std::memory_order_relaxed);
+      uint64_t k = tte[i].keyXorData.load(std::memory_order_relaxed) ^ w;
+
+      data[i] = unpack(w);
+
+      if (k == key)
+      {
+          if ((data[i].genBound8 & 0xF8) != generation8)
+          {
+              data[i].genBound8 = uint8_t(generation8 | (data[i].genBound8 & 0x7)); // Refresh
+              write(&tte[i], key, data[i]);
+          }
+
+          return found = true, TTEntry(&tte[i], nullptr, data[i]);
+      }
+
+      if (!k && !w) // Empty slot
+          return found = false, TTEntry(&tte[i], nullptr, data[i]);
+
+      if ((k >> 48) == (key >> 48))
+          rejectedHits.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Find an entry to be replaced according to the replacement strategy
+  const bool twoTier = replacePolicy == REPLACE_TWO_TIER;
+  int replace = 0;
+  for (int i = 1; i < ClusterSize - twoTier; ++i)
+      if (replace_value(data[replace]) > replace_value(data[i]))
+          replace = i;
+
+  return found = false, TTEntry(&tte[replace], twoTier ? &tte[ClusterSize - 1] : nullptr, data[replace]);
+}
+
+#endif
+
 
 /// TranspositionTable::hashfull() returns an approximation of the hashtable
 /// occupation during a search. The hash is x permill full, as per UCI protocol.
@@ -133,7 +514,142 @@ int TranspositionTable::hashfull() const {
   int cnt = 0;
   for (int i = 0; i < 1000 / ClusterSize; ++i)
       for (int j = 0; j < ClusterSize; ++j)
-          cnt += (table[i].entry[j].genBound8 & 0xF8) == generation8;
+#ifndef LOCKLESS_TT
+          cnt += (table[i].entry[j].data.genBound8 & 0xF8) == generation8;
+#else
+          cnt += (unpack(table[i].entry[j].data.load(std::memory_order_relaxed)).genBound8 & 0xF8) == generation8;
+#endif
 
   return cnt * 1000 / (ClusterSize * (1000 / ClusterSize));
 }
+
+
+/// TranspositionTable::false_hit_chance() estimates the chance that a probe for
+/// a position not in the table finds an entry with the same key bits anyway.
+/// It is the number of entries of any age in a cluster, sampled like in
+/// hashfull(), divided by the number of possible keys.
+
+double TranspositionTable::false_hit_chance() const {
+
+  int cnt = 0;
+  for (int i = 0; i < 1000 / ClusterSize; ++i)
+      for (int j = 0; j < ClusterSize; ++j)
+#ifndef LOCKLESS_TT
+          cnt += table[i].entry[j].key16 != 0;
+#else
+          cnt += table[i].entry[j].keyXorData.load(std::memory_order_relaxed) != 0;
+#endif
+
+  return double(cnt) / (1000 / ClusterSize) / std::pow(2.0, KeyBits);
+}
+
+
+/// TranspositionTable::save() writes the table and its generation to a file, so
+/// that a long analysis can be resumed after a restart with load().
+
+bool TranspositionTable::save(const std::string& fileName) const {
+
+  char header[HeaderSize] = {};
+  FileHeader h = {};
+
+  std::memcpy(h.magic, FileMagic, sizeof(FileMagic));
+  h.version      = FileVersion;
+  h.clusterSize  = sizeof(Cluster);
+  h.clusterCount = clusterCount;
+  h.generation8  = generation8;
+  std::memcpy(header, &h, sizeof(h));
+
+  std::ofstream file(fileName, std::ios::binary);
+  file.write(header, HeaderSize);
+  file.write(reinterpret_cast<const char*>(table), clusterCount * sizeof(Cluster));
+
+  if (!file)
+  {
+      sync_cout << "info string Failed to save the transposition table to " << fileName << sync_endl;
+      return false;
+  }
+
+  sync_cout << "info string Saved " << (clusterCount * sizeof(Cluster) >> 20)
+            << " MB transposition table to " << fileName << sync_endl;
+  return true;
+}
+
+
+/// TranspositionTable::load() restores a table written by save(). The file must
+/// have been saved with the current Hash size. Where possible the file is mapped
+/// copy-on-write, so nothing is copied upfront and pages are read on first use.
+
+bool TranspositionTable::load(const std::string& fileName) {
+
+  const size_t tableSize = clusterCount * sizeof(Cluster);
+  FileHeader h;
+  std::ifstream file(fileName, std::ios::binary);
+
+  if (!file.read(reinterpret_cast<char*>(&h), sizeof(h)))
+  {
+      sync_cout << "info string Failed to read a transposition table from " << fileName << sync_endl;
+      return false;
+  }
+
+  if (   std::memcmp(h.magic, FileMagic, sizeof(FileMagic))
+      || h.version != FileVersion
+      || h.clusterSize != sizeof(Cluster))
+  {
+      sync_cout << "info string " << fileName << " is not a transposition table saved by this engine" << sync_endl;
+      return false;
+  }
+
+  if (h.clusterCount != clusterCount)
+  {
+      sync_cout << "info string " << fileName << " was saved with Hash "
+                << (h.clusterCount * sizeof(Cluster) >> 20) << ", set Hash to this value first" << sync_endl;
+      return false;
+  }
+
+  file.seekg(0, std::ios::end);
+
+  if (size_t(file.tellg()) != HeaderSize + tableSize)
+  {
+      sync_cout << "info string " << fileName << " is truncated" << sync_endl;
+      return false;
+  }
+
+#ifndef _WIN32
+  int fd = open(fileName.c_str(), O_RDONLY);
+  void* mem = fd == -1 ? MAP_FAILED : mmap(nullptr, HeaderSize + tableSize,
+                                           PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (fd != -1)
+      close(fd);
+
+  if (mem != MAP_FAILED)
+  {
+      madvise(mem, HeaderSize + tableSize, MADV_WILLNEED); // Start reading ahead
+
+      free_table();
+      mappedFile = mem;
+      mappedSize = HeaderSize + tableSize;
+      table = reinterpret_cast<Cluster*>(static_cast<char*>(mem) + HeaderSize);
+      generation8 = h.generation8;
+
+      sync_cout << "info string Mapped " << (tableSize >> 20)
+                << " MB transposition table from " << fileName << sync_endl;
+      return true;
+  }
+#endif
+
+  // No mapping available, copy the clusters into the current table
+  file.seekg(HeaderSize);
+
+  if (!file.read(reinterpret_cast<char*>(table), tableSize))
+  {
+      clear();
+      sync_cout << "info string Failed to read a transposition table from " << fileName << sync_endl;
+      return false;
+  }
+
+  generation8 = h.generation8;
+
+  sync_cout << "info string Loaded " << (tableSize >> 20)
+            << " MB transposition table from " << fileName << sync_endl;
+  return true;
+}
@@ -21,12 +21,14 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <atomic>
+#include <string>
+
 #include "misc.h"
 #include "types.h"
 
-/// TTEntry struct is the 10 bytes transposition table entry, defined as below:
+/// TTData holds the contents of a transposition table entry, other than its key:
 ///
-/// key        16 bit
 /// move       16 bit
 /// value      16 bit
 /// eval value 16 bit
@@ -35,30 +37,92 @@
 /// bound type  2 bit
 /// depth       8 bit
 
-struct TTEntry {
+struct TTData {
+  uint16_t move16;
+  int16_t  value16;
+  int16_t  eval16;
+  uint8_t  genBound8;
+  uint8_t  depth8;
+};
+
+static_assert(sizeof(TTData) == 8, "TTData must fit in a 64 bit word");
+
+#ifndef LOCKLESS_TT
+
+/// TTSlot struct is the 10 bytes transposition table entry: the 16 highest bits
+/// of the key followed by TTData. Updates are not atomic and can be racy.
+
+struct TTSlot {
+  uint16_t key16;
+  TTData data;
+};
+
+#else
+
+/// TTSlot struct is the 16 bytes lockless transposition table entry: TTData as a
+/// single 64 bit word and the full key xored with it. Both words are read and
+/// written atomically, but not together, so an entry written by two threads at
+/// the same time, or read while being written, fails the key check and is seen
+/// as belonging to another position.
+
+struct TTSlot {
+  std::atomic<uint64_t> keyXorData;
+  std::atomic<uint64_t> data;
+};
+
+#endif
+
+
+/// ReplacePolicy selects the slot of a full cluster a new position goes to, see
+/// TranspositionTable::probe().
 
-  Move  move()  const { return (Move )move16; }
-  Value value() const { return (Value)value16; }
-  Value eval()  const { return (Value)eval16; }
-  Depth depth() const { return (Depth)(depth8 * int(ONE_PLY)) + DEPTH_OFFSET; }
-  bool is_pv() const { return (bool)(genBound8 & 0x4); }
-  Bound bound() const { return (Bound)(genBound8 & 0x3); }
+enum ReplacePolicy {
+  REPLACE_DEPTH, REPLACE_AGE, REPLACE_TWO_TIER
+};
+
+
+/// TTEntry is the handle to a table slot returned by TranspositionTable::probe().
+/// The lockless table verifies a copy of the slot in probe() and reads from it,
+/// the default one reads the slot itself.
+
+class TTEntry {
+
+#ifndef LOCKLESS_TT
+  const TTData& contents() const { return slot->data; }
+#else
+  const TTData& contents() const { return data; }
+#endif
+
+public:
+  TTEntry() = default;
+
+  Move  move()  const { return (Move )contents().move16; }
+  Value value() const { return (Value)contents().value16; }
+  Value eval()  const { return (Value)contents().eval16; }
+  Depth depth() const { return (Depth)(contents().depth8 * int(ONE_PLY)) + DEPTH_OFFSET; }
+  bool is_pv() const { return (bool)(contents().genBound8 & 0x4); }
+  Bound bound() const { return (Bound)(contents().genBound8 & 0x3); }
   void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev);
 
 private:
   friend class TranspositionTable;
 
-  uint16_t key16;
-  uint16_t move16;
-  int16_t  value16;
-  int16_t  eval16;
-  uint8_t  genBound8;
-  uint8_t  depth8;
+#ifndef LOCKLESS_TT
+  TTEntry(TTSlot* s, TTSlot* sp) : slot(s), spare(sp) {}
+#else
+  TTEntry(TTSlot* s, TTSlot* sp, const TTData& td) : slot(s), spare(sp), data(td) {}
+#endif
+
+  TTSlot* slot;
+  TTSlot* spare; // Always-replace slot of the cluster with REPLACE_TWO_TIER
+#ifdef LOCKLESS_TT
+  TTData data;
+#endif
 };
 
 
 /// A TranspositionTable consists of a power of 2 number of clusters and each
-/// cluster consists of ClusterSize number of TTEntry. Each non-empty entry
+/// cluster consists of ClusterSize number of TTSlot. Each non-empty entry
 /// contains information of exactly one position. The size of a cluster should
 /// divide the size of a cache line size, to ensure that clusters never cross
 /// cache lines. This ensures best cache performance, as the cacheline is
@@ -67,35 +131,68 @@ private:
 class TranspositionTable {
 
   static constexpr int CacheLineSize = 64;
+
+#ifndef LOCKLESS_TT
   static constexpr int ClusterSize = 3;
+  static constexpr int KeyBits = 16;
 
   struct Cluster {
-    TTEntry entry[ClusterSize];
+    TTSlot entry[ClusterSize];
     char padding[2]; // Align to a divisor of the cache line size
   };
+#else
+  static constexpr int ClusterSize = 4;
+  static constexpr int KeyBits = 64;
+
+  struct Cluster {
+    TTSlot entry[ClusterSize];
+  };
+#endif
 
   static_assert(CacheLineSize % sizeof(Cluster) == 0, "Cluster size incorrect");
 
 public:
- ~TranspositionTable() { free(mem); }
+ ~TranspositionTable() { free_table(); }
   void new_search() { generation8 += 8; } // Lower 3 bits are used by PV flag and Bound
-  TTEntry* probe(const Key key, bool& found) const;
+  TTEntry probe(const Key key, bool& found) const;
   int hashfull() const;
   void resize(size_t mbSize);
   void clear();
+  bool save(const std::string& fileName) const;
+  bool load(const std::string& fileName);
+  void set_replace_policy(const std::string& name);
+
+  double false_hit_chance() const;
+
+#ifdef LOCKLESS_TT
+  // Entries whose 16 highest key bits matched but the full key did not, that is
+  // the key collisions a table storing only those bits would have taken as hits.
+  // A torn read fails the check too, but its key is garbage and cannot be told
+  // apart from another position, so torn reads are not counted separately.
+  uint64_t rejected_hits() const { return rejectedHits.load(std::memory_order_relaxed); }
+#endif
 
   // The 32 lowest order bits of the key are used to get the index of the cluster
-  TTEntry* first_entry(const Key key) const {
+  TTSlot* first_entry(const Key key) const {
     return &table[(uint32_t(key) * uint64_t(clusterCount)) >> 32].entry[0];
   }
 
 private:
-  friend struct TTEntry;
+  friend class TTEntry;
+
+  void free_table();
+  int replace_value(const TTData& data) const;
+  void migrate(Cluster* to, size_t toCount, size_t idx) const;
 
   size_t clusterCount;
   Cluster* table;
-  void* mem;
-  uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
+  void* mappedFile;    // Non-null when the table is a file loaded with load()
+  size_t mappedSize;
+  uint8_t generation8; // Size must be not bigger than TTData::genBound8
+  ReplacePolicy replacePolicy;
+#ifdef LOCKLESS_TT
+  mutable std::atomic<uint64_t> rejectedHits;
+#endif
 };
 
 extern TranspositionTable TT;
@@ -20,11 +20,14 @@
 
 #include <cassert>
 #include <cmath>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <stdlib.h>
 
+#include "cluster.h"
 #include "evaluate.h"
 #include "movegen.h"
 #include "position.h"
@@ -38,12 +41,16 @@
 using namespace std;
 
 extern vector<string> setup_bench(const Position&, istream&);
+extern void microbench(istream&);
 
 namespace {
 
   // FEN string of the initial position, normal chess
   const char* StartFEN = "rnsmksnr/8/pppppppp/8/8/PPPPPPPP/8/RNSKMSNR w 0 1";
 
+  // True when the engine serves a cluster coordinator, see UCI::loop()
+  bool WorkerMode = false;
+
 
   // position() is called when engine receives the "position" UCI command.
   // The function sets up the position described in the given FEN string ("fen")
@@ -77,6 +84,8 @@ namespace {
         states->emplace_back();
         pos.do_move(m, states->back());
     }
+
+    Cluster::set_position(is.str());
   }
 
 
@@ -97,10 +106,19 @@ namespace {
     while (is >> token)
         value += (value.empty() ? "" : " ") + token;
 
-    if (Options.count(name))
-        Options[name] = value;
-    else
+    auto it = Options.find(name);
+
+    if (it == Options.end())
         sync_cout << "No such option: " << name << sync_endl;
+
+    else if (WorkerMode && it->first == "Debug Log File") // Would write a file on this host
+        sync_cout << "info string " << it->first << " is disabled in worker mode" << sync_endl;
+
+    else
+    {
+        it->second = value;
+        Cluster::set_option(it->first, value);
+    }
   }
 
 
@@ -138,6 +156,33 @@ namespace {
   }
 
 
+  // tt() is called when engine receives the "tt save <file>" or "tt load <file>"
+  // command. It writes the transposition table to disk or maps it back, so
+  // that the analysis of a position can be resumed after a restart. Note that
+  // "ucinewgame" clears the table, so a GUI must load it afterwards.
+
+  void tt(istringstream& is) {
+
+    string token, fileName;
+
+    is >> token;
+    getline(is >> ws, fileName); // The file name may contain spaces
+
+    if ((token != "save" && token != "load") || fileName.empty())
+    {
+        sync_cout << "info string Usage: tt save <file> | tt load <file>" << sync_endl;
+        return;
+    }
+
+    Threads.main()->wait_for_search_finished();
+
+    if (token == "save")
+        TT.save(fileName);
+    else
+        TT.load(fileName);
+  }
+
+
   // bench() is called when engine receives the "bench" command. Firstly
   // a list of UCI commands is setup according to bench parameters, then
   // it is run one by one printing a summary at the end.
@@ -146,6 +191,10 @@ namespace {
 
     string token;
     uint64_t num, nodes = 0, cnt = 1;
+#ifdef TT_STATS
+    uint64_t ttProbes = 0, ttHits = 0;
+    double ttFalseHits = 0;
+#endif
 
     vector<string> list = setup_bench(pos, args);
     num = count_if(list.begin(), list.end(), [](string s) { return s.find("go ") == 0; });
@@ -163,6 +212,16 @@ namespace {
             go(pos, is, states);
             Threads.main()->wait_for_search_finished();
             nodes += Threads.nodes_searched();
+
+#ifdef TT_STATS
+            uint64_t probes = 0, hits = 0;
+            for (Thread* th : Threads)
+                probes += th->ttProbes, hits += th->ttHits;
+
+            ttProbes += probes;
+            ttHits += hits;
+            ttFalseHits += (probes - hits) * TT.false_hit_chance();
+#endif
         }
         else if (token == "setoption")  setoption(is);
         else if (token == "position")   position(pos, is, states);
@@ -177,6 +236,104 @@ namespace {
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
          << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+
+    cerr << "TT replacement  : " << string(Options["TT Replace"]) << endl;
+
+#ifdef TT_STATS
+    cerr << "TT hit rate (%) : " << fixed << setprecision(2) << 100.0 * ttHits / max(ttProbes, uint64_t(1))
+         << "\nTT false hits   : " << ttFalseHits << " (estimated)" << endl;
+#endif
+
+#ifdef LOCKLESS_TT
+    cerr << "TT key collisions: " << TT.rejected_hits()
+         << " (16-bit key matches rejected by the full key, torn reads cannot be counted separately)" << endl;
+#endif
+  }
+
+
+  // smpbench() is called when engine receives the "smpbench" command. It runs
+  // the bench positions to a fixed depth with 1, 2, 4... up to the given number
+  // of threads and reports for each run the time to depth, the speedup over the
+  // single thread run, and on how many positions the best move of that run was
+  // found, with the nodes spent on those positions. Parameters are the TT size
+  // in MB, the maximum number of threads, the depth and the positions as for
+  // bench.
+  //
+  // smpbench -> 16MB TT, 1 to hardware threads, depth 13, default positions
+  // smpbench 256 32 18 -> 256MB TT, 1 to 32 threads, depth 18
+
+  void smpbench(Position& pos, istream& args, StateListPtr& states) {
+
+    struct Run {
+      size_t threads;
+      TimePoint time;
+      uint64_t nodes, solvedNodes;
+      int solved;
+    };
+
+    string token;
+    string ttSize  = (args >> token) ? token : "16";
+    size_t maxThreads = (args >> token) ? size_t(max(stoi(token), 1))
+                                        : max(size_t(thread::hardware_concurrency()), size_t(1));
+    string depth   = (args >> token) ? token : "13";
+    string fenFile = (args >> token) ? token : "default";
+
+    vector<size_t> threadCounts;
+    for (size_t n = 1; n < maxThreads; n *= 2)
+        threadCounts.push_back(n);
+    threadCounts.push_back(maxThreads);
+
+    vector<Move> solutions;
+    vector<Run> runs;
+
+    for (size_t n : threadCounts)
+    {
+        istringstream ss(ttSize + " " + to_string(n) + " " + depth + " " + fenFile + " depth");
+        Run run = { n, 0, 0, 0, 0 };
+        size_t cnt = 0;
+
+        for (const auto& cmd : setup_bench(pos, ss))
+        {
+            istringstream is(cmd);
+            is >> skipws >> token;
+
+            if (token == "go")
+            {
+                TimePoint start = now();
+                go(pos, is, states);
+                Threads.main()->wait_for_search_finished();
+                run.time += now() - start;
+
+                // A depth limited search always plays the move of the main thread
+                uint64_t nodes = Threads.nodes_searched();
+                Move best = Threads.main()->rootMoves[0].pv[0];
+
+                if (n == 1)
+                    solutions.push_back(best);
+
+                run.nodes += nodes;
+                if (best == solutions[cnt++])
+                    run.solved++, run.solvedNodes += nodes;
+            }
+            else if (token == "setoption")  setoption(is);
+            else if (token == "position")   position(pos, is, states);
+            else if (token == "ucinewgame") Search::clear();
+        }
+
+        runs.push_back(run);
+    }
+
+    cerr << "\n==========================="
+         << "\nThreads  Time (ms)  Speedup       Nodes  Nodes/second  Solved  Nodes per solution" << endl;
+
+    for (const Run& r : runs)
+        cerr << setw(7)  << r.threads
+             << setw(11) << r.time
+             << setw(9)  << fixed << setprecision(2) << double(runs[0].time) / max(r.time, TimePoint(1))
+             << setw(12) << r.nodes
+             << setw(14) << 1000 * r.nodes / max(r.time, TimePoint(1))
+             << setw(5)  << r.solved << '/' << left << setw(3) << solutions.size() << right
+             << setw(19) << r.solvedNodes / max(r.solved, 1) << endl;
   }
 
 } // namespace
@@ -197,6 +354,14 @@ void UCI::loop(int argc, char* argv[]) {
 
   pos.set(StartFEN, false, &states->back(), uiThread.get());
 
+  // A worker serves a coordinator over the connection instead of the console
+  if (argc == 3 && std::string(argv[1]) == "worker")
+  {
+      Cluster::listen(argv[2]);
+      WorkerMode = true;
+      argc = 1;
+  }
+
   for (int i = 1; i < argc; ++i)
       cmd += std::string(argv[i]) + " ";
 
@@ -211,14 +376,21 @@ void UCI::loop(int argc, char* argv[]) {
 
       if (    token == "quit"
           ||  token == "stop")
+      {
           Threads.stop = true;
+          Threads.main()->on_stop_or_ponderhit();
+          Cluster::stop();
+      }
 
       // The GUI sends 'ponderhit' to tell us the user has played the expected move.
       // So 'ponderhit' will be sent if we were told to ponder on the same move the
       // user has played. We should continue searching but switch from pondering to
       // normal search.
       else if (token == "ponderhit")
+      {
           Threads.main()->ponder = false; // Switch to normal search
+          Threads.main()->on_stop_or_ponderhit();
+      }
 
       else if (token == "uci")
           sync_cout << "id name " << engine_info(true)
@@ -332,6 +504,20 @@ void UCI::loop(int argc, char* argv[]) {
       // Additional custom non-UCI commands, mainly for debugging
       else if (token == "flip")  pos.flip();
       else if (token == "bench") bench(pos, is, states);
+      else if (token == "smpbench") smpbench(pos, is, states);
+      else if (WorkerMode && (token == "tt" || token == "export_net"))
+          sync_cout << "info string " << token << " is disabled in worker mode" << sync_endl;
+      else if (token == "tt")    tt(is);
+      else if (token == "microbench") microbench(is);
+      else if (token == "ttshare" && WorkerMode) Cluster::receive(is); // Only from the coordinator
+      else if (token == "export_net")
+      {
+          string filename;
+          if (is >> filename)
+              Eval::NNUE::export_net(filename);
+          else
+              sync_cout << "Usage: export_net <filename>" << sync_endl;
+      }
       else if (token == "d")     sync_cout << pos << sync_endl;
       else if (token == "eval")  sync_cout << Eval::trace(pos) << sync_endl;
       else
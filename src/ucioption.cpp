@@ -23,6 +23,8 @@
 #include <ostream>
 #include <sstream>
 
+#include "evaluate.h"
+#include "cluster.h"
 #include "misc.h"
 #include "search.h"
 #include "thread.h"
@@ -40,9 +42,14 @@ namespace UCI {
 /// 'On change' actions, triggered by an option's value change
 void on_clear_hash(const Option&) { Search::clear(); }
 void on_hash_size(const Option& o) { TT.resize(o); }
+void on_tt_replace(const Option& o) { TT.set_replace_policy(o); }
 void on_logger(const Option& o) { start_logger(o); }
 void on_threads(const Option& o) { Threads.set(o); }
+void on_thread_binding(const Option&) { Threads.set(0); Threads.set(Options["Threads"]); }
+void on_cluster_workers(const Option& o) { Cluster::connect(o); }
 void on_tb_path(const Option& o) { Tablebases::init(o); }
+void on_use_NNUE(const Option& ) { Eval::NNUE::init(); }
+void on_eval_file(const Option& ) { Eval::NNUE::init(); }
 
 
 /// Our case insensitive less() function as required by UCI protocol
@@ -63,8 +70,14 @@ void init(OptionsMap& o) {
   o["Debug Log File"]        << Option("", on_logger);
   o["Contempt"]              << Option(24, -100, 100);
   o["Threads"]               << Option(1, 1, 512, on_threads);
+  o["Thread Binding"]        << Option("spread", {"spread", "compact", "none"}, on_thread_binding);
+  o["SMP Depth Skip"]        << Option(false);
+  o["SMP Window Offset"]     << Option(0, 0, 100);
+  o["SMP ABDADA"]            << Option(false);
+  o["Cluster Workers"]       << Option("<empty>", on_cluster_workers);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
   o["Clear Hash"]            << Option(on_clear_hash);
+  o["TT Replace"]            << Option("Depth", {"Depth", "Age", "Two-tier"}, on_tt_replace);
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
   o["Skill Level"]           << Option(20, 0, 20);
@@ -81,6 +94,8 @@ void init(OptionsMap& o) {
   o["Syzygy50MoveRule"]      << Option(false);
   o["SyzygyProbeLimit"]      << Option(7, 0, 7);
   o["Honour's Rule"]         << Option(true);
+  o["Use NNUE"]              << Option(false, on_use_NNUE);
+  o["EvalFile"]              << Option(EvalFileDefaultName, on_eval_file);
 }
 
 
@@ -167,22 +182,22 @@ Option& Option::operator=(const string& v) {
 
   if (   (type != "button" && v.empty())
       || (type == "check" && v != "true" && v != "false")
-      || (type == "combo" && (std::find(comboValues.begin(), comboValues.end(), v) == comboValues.end()))
       || (type == "spin" && (stoi(v) < min || stoi(v) > max)))
       return *this;
 
   if (type == "combo")
   {
-      OptionsMap comboMap; // To have case insensitive compare
-      string token;
-      std::istringstream ss(defaultValue);
-      while (ss >> token)
-          comboMap[token] << Option();
-      if (!comboMap.count(v) || v == "var")
+      // Case insensitive compare, storing the spelling of the listed value
+      auto it = std::find_if(comboValues.begin(), comboValues.end(), [&](const string& c) {
+          return !CaseInsensitiveLess()(c, v) && !CaseInsensitiveLess()(v, c);
+      });
+
+      if (it == comboValues.end())
           return *this;
-  }
 
-  if (type != "button")
+      currentValue = *it;
+  }
+  else if (type != "button")
       currentValue = v;
 
   if (on_change)
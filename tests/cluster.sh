@@ -0,0 +1,84 @@
+#!/bin/bash
+# measure cluster search time against the number of processes, all on this host
+# usage: cluster.sh [max processes] [depth] [positions]
+
+error()
+{
+  echo "cluster testing failed on line $1"
+  kill $workers 2>/dev/null
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+maxprocs=${1:-4}
+depth=${2:-14}
+positions=${3:-8}
+
+echo "cluster testing started"
+
+# the first positions of the bench, searched one after the other
+cat << EOF > cluster.exp
+ set timeout 600
+ lassign \$argv workers depth positions
+ spawn ./stockfish
+
+ send "setoption name Cluster Workers value \$workers\n"
+
+ set fens {
+  "rnsmksnr/8/pppppppp/8/8/PPPPPPPP/8/RNSKMSNR w 0 1"
+  "r3k2r/2ms1s2/ppn1ppnp/2ppP3/3P1M2/PPPS1NPP/5S2/RN1K3R b 0 2"
+  "r3k2r/2ms1s2/ppn1ppnp/3pP3/3P1M2/PP1S1NPP/5S2/RN1K3R b 0 3"
+  "r3k2r/2msns2/ppn1pp1p/2ppP3/3P1M2/PPP2NPP/2S2S2/RN1K3R b 0 2"
+  "r3k2r/2msns2/ppn1pp1p/3pP3/3P1M2/PP3NPP/2S2S2/RN1K3R b 0 3"
+  "r3k2r/3sns2/ppnmpp1p/3pP3/3P1M2/PP1S1NPP/2KNS3/R6R b 0 2"
+  "r3k2r/3sns2/ppnmpp1p/2ppP3/3P1M2/PPPS1NPP/2KNS3/R6R b 0 1"
+  "r3k1nr/3s1s2/ppn2ppp/2m1p3/3pPP2/P1PP1NPP/2SNSM2/1R1K3R w 0 2"
+ }
+
+ send "ucinewgame\n"
+ foreach fen [lrange \$fens 0 [expr \$positions - 1]] {
+  send "position fen \$fen\n"
+  send "go depth \$depth\n"
+  expect "bestmove"
+ }
+
+ # a stop from the GUI must end a depth limited search on the workers too
+ send "go depth 60\n"
+ after 1000
+ send "stop\n"
+ set timeout 10
+ expect {
+  "bestmove" {}
+  timeout { exit 1 }
+ }
+
+ send "quit\n"
+ expect eof
+EOF
+
+for procs in `seq 1 $maxprocs`
+do
+  # start the workers on Unix domain sockets
+  workers=""
+  addresses=""
+  for i in `seq 2 $procs`
+  do
+    rm -f cluster$i.sock
+    ./stockfish worker unix:cluster$i.sock > /dev/null 2>&1 &
+    workers="$workers $!"
+    addresses="$addresses${addresses:+,}unix:cluster$i.sock"
+  done
+  sleep 1
+
+  start=`date +%s%N`
+  expect cluster.exp "${addresses:-<empty>}" $depth $positions > /dev/null
+  end=`date +%s%N`
+
+  wait $workers
+  rm -f cluster*.sock
+  echo "processes $procs time $(( (end - start) / 1000000 )) ms"
+done
+
+rm cluster.exp
+
+echo "cluster testing OK"
@@ -0,0 +1,48 @@
+#!/bin/bash
+# compare the bench speed of the default and the lockless transposition table
+# usage: lockless.sh [ARCH] [threads] [runs], run from the src directory
+
+error()
+{
+  echo "lockless testing failed on line $1"
+  rm -rf "$tmp"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+arch=${1:-x86-64-modern}
+threads=${2:-1}
+runs=${3:-3}
+
+echo "lockless testing started"
+
+# build both binaries in a copy of the sources, leaving the binary and the
+# objects of this directory alone
+tmp=`mktemp -d`
+cp -r . "$tmp/src"
+
+for lockless in no yes
+do
+  make -C "$tmp/src" objclean > /dev/null
+  make -C "$tmp/src" -j build ARCH=$arch lockless=$lockless > /dev/null 2>&1
+  mv "$tmp/src/stockfish" stockfish-lockless-$lockless
+done
+
+rm -rf "$tmp"
+
+for lockless in no yes
+do
+  total=0
+  for run in `seq 1 $runs`
+  do
+    output=`./stockfish-lockless-$lockless bench 16 $threads 13 2>&1`
+    nps=`echo "$output" | grep "Nodes/second" | awk '{print $3}'`
+    total=$(( total + nps ))
+  done
+  echo "lockless=$lockless threads $threads average nps $(( total / runs ))"
+  echo "$output" | grep "TT key collisions" || true
+done
+
+rm -f stockfish-lockless-no stockfish-lockless-yes
+
+echo "lockless testing OK"